@@ -195,6 +195,7 @@ typedef enum rs_option
     RS_OPTION_FRAMES_QUEUE_SIZE                               , /**< Number of frames the user is allowed to keep per stream. Trying to hold on to more frames will cause frame-drops.*/
     RS_OPTION_HARDWARE_LOGGER_ENABLED                         , /**< Enable/disable fetching log data from the device */
     RS_OPTION_TOTAL_FRAME_DROPS                               , /**< Total number of detected frame drops from all streams */
+    RS_OPTION_RECTIFIED_COLOR_INTERPOLATION                   , /**< Rectified color resampling: 0 - nearest, 1 - bilinear. Depth formats are always nearest. */
     RS_OPTION_COUNT                                           , /**< Number of enumeration values. Not a valid input: intended to be used in for-loops. */
 
 } rs_option;
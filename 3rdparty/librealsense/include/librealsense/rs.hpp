@@ -154,6 +154,7 @@ namespace rs
         frames_queue_size                               , /**< Number of frames the user is allowed to keep per stream. Trying to hold on to more frames will cause frame-drops.*/
         hardware_logger_enabled                         , /**< Enable/disable fetching log data from the device */
         total_frame_drops                               , /**< Total number of detected frame drops from all streams*/
+        rectified_color_interpolation                   , /**< Rectified color resampling: 0 - nearest, 1 - bilinear. Depth formats are always nearest. */
     };
 
     /// \brief Types of value provided from the device with each frame
@@ -525,6 +525,7 @@ rs_frame_ref* ::rs_device_base::clone_frame(rs_frame_ref* frame)
 void rs_device_base::update_device_info(rsimpl::static_device_info& info)
 {
     info.options.push_back({ RS_OPTION_FRAMES_QUEUE_SIZE,     1, RS_USER_QUEUE_SIZE,      1, RS_USER_QUEUE_SIZE });
+    info.options.push_back({ RS_OPTION_RECTIFIED_COLOR_INTERPOLATION, 0, 1,               1, 0 });
 }
 
 const char * rs_device_base::get_option_description(rs_option option) const
@@ -599,6 +600,7 @@ const char * rs_device_base::get_option_description(rs_option option) const
     case RS_OPTION_FISHEYE_AUTO_EXPOSURE_SKIP_FRAMES               : return "In Fisheye auto-exposure sample every given number of frames";
     case RS_OPTION_HARDWARE_LOGGER_ENABLED                         : return "Enables / disables fetching diagnostic information from hardware (and writting the results to log)";
     case RS_OPTION_TOTAL_FRAME_DROPS                               : return "Total number of detected frame drops from all streams";
+    case RS_OPTION_RECTIFIED_COLOR_INTERPOLATION                   : return "Rectified color resampling, 0 - nearest, 1 - bilinear (depth formats are always nearest)";
     default: return rs_option_to_string(option);
     }
 }
@@ -670,6 +672,9 @@ void rs_device_base::set_options(const rs_option options[], size_t count, const
         case RS_OPTION_TOTAL_FRAME_DROPS:
             frames_drops_counter = (uint32_t)values[i];
             break;
+        case RS_OPTION_RECTIFIED_COLOR_INTERPOLATION:
+            rect_color.set_interpolation(values[i] ? rect_interpolation::bilinear : rect_interpolation::nearest);
+            break;
         default:
             LOG_WARNING("Cannot set " << options[i] << " to " << values[i] << " on " << get_name());
             throw std::logic_error("Option unsupported");
@@ -690,6 +695,9 @@ void rs_device_base::get_options(const rs_option options[], size_t count, double
         case  RS_OPTION_TOTAL_FRAME_DROPS:
             values[i] = frames_drops_counter;
             break;
+        case RS_OPTION_RECTIFIED_COLOR_INTERPOLATION:
+            values[i] = rect_color.get_interpolation() == rect_interpolation::bilinear ? 1 : 0;
+            break;
         default:
             LOG_WARNING("Cannot get " << options[i] << " on " << get_name());
             throw std::logic_error("Option unsupported");
@@ -485,27 +485,111 @@ namespace rsimpl
     // Deprojection //
     //////////////////
 
-    template<class MAP_DEPTH> void deproject_depth(float * points, const rs_intrinsics & intrin, const uint16_t * depth, MAP_DEPTH map_depth)
+    // Calibration-derived tables are shared process-wide, and dropped once the last stream using them lets go
+    template<class TABLE, class MATCH, class BUILD> std::shared_ptr<const TABLE> find_or_build_table(std::vector<std::weak_ptr<const TABLE>> & cache, std::mutex & mutex, MATCH match, BUILD build)
     {
-        for(int y=0; y<intrin.height; ++y)
+        std::lock_guard<std::mutex> lock(mutex);
+        cache.erase(std::remove_if(begin(cache), end(cache), [](const std::weak_ptr<const TABLE> & entry) { return entry.expired(); }), end(cache));
+        for(auto & entry : cache)
         {
-            for(int x=0; x<intrin.width; ++x)
+            auto table = entry.lock();
+            if(table && match(*table)) return table;
+        }
+
+        auto table = std::make_shared<TABLE>();
+        build(*table);
+        cache.push_back(table);
+        return table;
+    }
+
+    std::shared_ptr<const deprojection_table> get_deprojection_table(const rs_intrinsics & intrin)
+    {
+        static std::mutex mutex;
+        static std::vector<std::weak_ptr<const deprojection_table>> cache;
+
+        return find_or_build_table(cache, mutex, [&intrin](const deprojection_table & table) { return table.intrin == intrin; }, [&intrin](deprojection_table & table)
+        {
+            table.intrin = intrin;
+            table.rays.resize(intrin.width * intrin.height * 2);
+            for(int y=0; y<intrin.height; ++y)
             {
-                const float pixel[] = { (float) x, (float) y};
-                rs_deproject_pixel_to_point(points, &intrin, pixel, map_depth(*depth++));
-                points += 3;                
+                for(int x=0; x<intrin.width; ++x)
+                {
+                    // Deprojecting at a depth of one yields the ray, since deprojection is linear in depth
+                    const float pixel[] = { (float) x, (float) y};
+                    float point[3];
+                    rs_deproject_pixel_to_point(point, &intrin, pixel, 1.0f);
+                    table.rays[(y * intrin.width + x) * 2 + 0] = point[0];
+                    table.rays[(y * intrin.width + x) * 2 + 1] = point[1];
+                }
             }
-        }    
+        });
+    }
+
+    template<class MAP_DEPTH> void deproject_depth(float * points, const deprojection_table & table, const uint16_t * depth, MAP_DEPTH map_depth)
+    {
+        const int width = table.intrin.width;
+#pragma omp parallel for schedule(static)
+        for(int y=0; y<table.intrin.height; ++y)
+        {
+            const float * ray = table.rays.data() + y * width * 2;
+            const uint16_t * in = depth + y * width;
+            float * out = points + y * width * 3;
+            int x = 0;
+#ifdef __SSSE3__
+            // Four pixels at a time: scale the rays by depth, then interleave back into xyz triplets
+            for(; x + 4 <= width; x += 4, ray += 8, in += 4, out += 12)
+            {
+                const __m128 d = map_depth(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(in)), _mm_setzero_si128())));
+                const __m128 xy01 = _mm_mul_ps(_mm_loadu_ps(ray + 0), _mm_unpacklo_ps(d, d)); // X0 Y0 X1 Y1
+                const __m128 xy23 = _mm_mul_ps(_mm_loadu_ps(ray + 4), _mm_unpackhi_ps(d, d)); // X2 Y2 X3 Y3
+
+                const __m128 d0x1 = _mm_shuffle_ps(d, xy01, _MM_SHUFFLE(2,2,0,0));            // d0 d0 X1 X1
+                const __m128 y1d1 = _mm_shuffle_ps(xy01, d, _MM_SHUFFLE(1,1,3,3));            // Y1 Y1 d1 d1
+                const __m128 d2x3 = _mm_shuffle_ps(d, xy23, _MM_SHUFFLE(2,2,2,2));            // d2 d2 X3 X3
+                const __m128 y3d3 = _mm_shuffle_ps(xy23, d, _MM_SHUFFLE(3,3,3,3));            // Y3 Y3 d3 d3
+                _mm_storeu_ps(out + 0, _mm_shuffle_ps(xy01, d0x1, _MM_SHUFFLE(2,0,1,0)));     // X0 Y0 d0 X1
+                _mm_storeu_ps(out + 4, _mm_shuffle_ps(y1d1, xy23, _MM_SHUFFLE(1,0,2,0)));     // Y1 d1 X2 Y2
+                _mm_storeu_ps(out + 8, _mm_shuffle_ps(d2x3, y3d3, _MM_SHUFFLE(2,0,2,0)));     // d2 X3 Y3 d3
+            }
+#endif
+            for(; x < width; ++x, ray += 2, ++in, out += 3)
+            {
+                const float d = map_depth(static_cast<float>(*in));
+                out[0] = ray[0] * d;
+                out[1] = ray[1] * d;
+                out[2] = d;
+            }
+        }
     }
 
-    void deproject_z(float * points, const rs_intrinsics & z_intrin, const uint16_t * z_pixels, float z_scale)
+    // The depth mappings below are shared by the scalar and SSE paths of deproject_depth
+    struct map_z
     {
-        deproject_depth(points, z_intrin, z_pixels, [z_scale](uint16_t z) { return z_scale * z; });
+        float scale;
+        float operator()(float z) const { return scale * z; }
+#ifdef __SSSE3__
+        __m128 operator()(__m128 z) const { return _mm_mul_ps(_mm_set1_ps(scale), z); }
+#endif
+    };
+
+    struct map_disparity
+    {
+        float scale;
+        float operator()(float disparity) const { return scale / disparity; }
+#ifdef __SSSE3__
+        __m128 operator()(__m128 disparity) const { return _mm_div_ps(_mm_set1_ps(scale), disparity); }
+#endif
+    };
+
+    void deproject_z(float * points, const deprojection_table & z_rays, const uint16_t * z_pixels, float z_scale)
+    {
+        deproject_depth(points, z_rays, z_pixels, map_z{z_scale});
     }
 
-    void deproject_disparity(float * points, const rs_intrinsics & disparity_intrin, const uint16_t * disparity_pixels, float disparity_scale)
+    void deproject_disparity(float * points, const deprojection_table & disparity_rays, const uint16_t * disparity_pixels, float disparity_scale)
     {
-        deproject_depth(points, disparity_intrin, disparity_pixels, [disparity_scale](uint16_t disparity) { return disparity_scale / disparity; });
+        deproject_depth(points, disparity_rays, disparity_pixels, map_disparity{disparity_scale});
     }
 
     /////////////////////
@@ -614,23 +698,146 @@ namespace rsimpl
         return rectification_table;
     }
 
-    template<class T> void rectify_image_pixels(T * rect_pixels, const std::vector<int> & rectification_table, const T * unrect_pixels)
+    static void compute_bilinear_rectification_table(rectification_table & table)
+    {
+        const auto & rect_intrin = table.rect_intrin, & unrect_intrin = table.unrect_intrin;
+        table.indices.resize(rect_intrin.width * rect_intrin.height);
+        table.weights.resize(rect_intrin.width * rect_intrin.height * 2);
+        const float max_x = (float)std::max(unrect_intrin.width - 2, 0), max_y = (float)std::max(unrect_intrin.height - 2, 0);
+
+#pragma omp parallel for schedule(dynamic)
+        for(int y = 0; y < rect_intrin.height; ++y)
+        {
+            int rect_pixel_index = y * rect_intrin.width;
+            for(int x = 0; x < rect_intrin.width; ++x, ++rect_pixel_index)
+            {
+                // Map the center of the rectified pixel onto the unrectified image, and clamp to its border
+                float rect_pixel[2] = {(float)x, (float)y}, rect_point[3], unrect_point[3], unrect_pixel[2];
+                rs_deproject_pixel_to_point(rect_point, &rect_intrin, rect_pixel, 1.0f);
+                rs_transform_point_to_point(unrect_point, &table.rect_to_unrect, rect_point);
+                rs_project_point_to_pixel(unrect_pixel, &unrect_intrin, unrect_point);
+                const float u = std::min(std::max(unrect_pixel[0], 0.0f), max_x + 1), v = std::min(std::max(unrect_pixel[1], 0.0f), max_y + 1);
+                const float u0 = std::min(std::floor(u), max_x), v0 = std::min(std::floor(v), max_y);
+
+                table.indices[rect_pixel_index] = (int)v0 * unrect_intrin.width + (int)u0;
+                table.weights[rect_pixel_index * 2 + 0] = (uint16_t)((u - u0) * 256 + 0.5f);
+                table.weights[rect_pixel_index * 2 + 1] = (uint16_t)((v - v0) * 256 + 0.5f);
+            }
+        }
+    }
+
+    bool rectification_table::matches(const rs_intrinsics & rect, const rs_extrinsics & extrin, const rs_intrinsics & unrect, rect_interpolation interp) const
+    {
+        return interpolation == interp && rect_intrin == rect && unrect_intrin == unrect && rect_to_unrect == extrin;
+    }
+
+    std::shared_ptr<const rectification_table> get_rectification_table(const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin, rect_interpolation interpolation)
+    {
+        static std::mutex mutex;
+        static std::vector<std::weak_ptr<const rectification_table>> cache;
+
+        return find_or_build_table(cache, mutex,
+            [&](const rectification_table & table) { return table.matches(rect_intrin, rect_to_unrect, unrect_intrin, interpolation); },
+            [&](rectification_table & table)
+        {
+            table.rect_intrin = rect_intrin;
+            table.unrect_intrin = unrect_intrin;
+            table.rect_to_unrect = rect_to_unrect;
+            table.interpolation = interpolation;
+            if(interpolation == rect_interpolation::bilinear) compute_bilinear_rectification_table(table);
+            else table.indices = compute_rectification_table(rect_intrin, rect_to_unrect, unrect_intrin);
+        });
+    }
+
+    // The rectified image is produced in tiles so that the source rows touched by one tile stay in cache, and tiles are spread across threads
+    const int RECTIFY_TILE_WIDTH = 128;
+    const int RECTIFY_TILE_HEIGHT = 8;
+
+    template<class TILE_FUNC> void for_each_rectify_tile(const rs_intrinsics & rect_intrin, TILE_FUNC tile_func)
+    {
+        const int tiles_x = (rect_intrin.width + RECTIFY_TILE_WIDTH - 1) / RECTIFY_TILE_WIDTH;
+        const int tiles_y = (rect_intrin.height + RECTIFY_TILE_HEIGHT - 1) / RECTIFY_TILE_HEIGHT;
+
+#pragma omp parallel for schedule(dynamic)
+        for(int tile = 0; tile < tiles_x * tiles_y; ++tile)
+        {
+            const int x0 = (tile % tiles_x) * RECTIFY_TILE_WIDTH, y0 = (tile / tiles_x) * RECTIFY_TILE_HEIGHT;
+            const int x1 = std::min(x0 + RECTIFY_TILE_WIDTH, rect_intrin.width), y1 = std::min(y0 + RECTIFY_TILE_HEIGHT, rect_intrin.height);
+            for(int y = y0; y < y1; ++y) tile_func(y * rect_intrin.width + x0, x1 - x0);
+        }
+    }
+
+    template<class T> void rectify_image_pixels(T * rect_pixels, const rectification_table & table, const T * unrect_pixels)
     {
-        for(auto entry : rectification_table) *rect_pixels++ = unrect_pixels[entry];
+        const int * indices = table.indices.data();
+        for_each_rectify_tile(table.rect_intrin, [rect_pixels, indices, unrect_pixels](int first, int count)
+        {
+            // Work on locals, byte-sized stores would otherwise force the captures to be reloaded for every pixel
+            const int * entry = indices + first, * last = entry + count;
+            const T * in = unrect_pixels;
+            T * out = rect_pixels + first;
+            while(entry != last) *out++ = in[*entry++];
+        });
     }
 
-    void rectify_image(uint8_t * rect_pixels, const std::vector<int> & rectification_table, const uint8_t * unrect_pixels, rs_format format)
+    template<class C, int N> void rectify_image_pixels_bilinear(C * rect_pixels, const rectification_table & table, const C * unrect_pixels)
     {
+        const int * indices = table.indices.data();
+        const uint16_t * weights = table.weights.data();
+        const int unrect_stride = table.unrect_intrin.width * N;
+        for_each_rectify_tile(table.rect_intrin, [rect_pixels, indices, weights, unrect_pixels, unrect_stride](int first, int count)
+        {
+            const int * entry = indices + first, * last = entry + count;
+            const uint16_t * weight = weights + first * 2;
+            const C * in = unrect_pixels;
+            const int stride = unrect_stride;
+            C * out = rect_pixels + first * N;
+            for(; entry != last; ++entry, weight += 2, out += N)
+            {
+                const uint32_t wx = weight[0], wy = weight[1];
+                const C * top = in + *entry * N, * bottom = top + stride;
+                uint32_t blended[N];
+                for(int c = 0; c < N; ++c)
+                {
+                    const uint32_t t = top[c] * (256 - wx) + top[c + N] * wx;
+                    const uint32_t b = bottom[c] * (256 - wx) + bottom[c + N] * wx;
+                    blended[c] = (t * (256 - wy) + b * wy + (1 << 15)) >> 16;
+                }
+                for(int c = 0; c < N; ++c) out[c] = static_cast<C>(blended[c]);
+            }
+        });
+    }
+
+    void rectify_image(uint8_t * rect_pixels, const rectification_table & table, const uint8_t * unrect_pixels, rs_format format)
+    {
+        if(table.interpolation == rect_interpolation::bilinear)
+        {
+            switch(format)
+            {
+            case RS_FORMAT_Y8: 
+                return rectify_image_pixels_bilinear<uint8_t, 1>(rect_pixels, table, unrect_pixels);
+            case RS_FORMAT_Y16: 
+                return rectify_image_pixels_bilinear<uint16_t, 1>((uint16_t *)rect_pixels, table, (const uint16_t *)unrect_pixels);
+            case RS_FORMAT_RGB8: case RS_FORMAT_BGR8: 
+                return rectify_image_pixels_bilinear<uint8_t, 3>(rect_pixels, table, unrect_pixels);
+            case RS_FORMAT_RGBA8: case RS_FORMAT_BGRA8: 
+                return rectify_image_pixels_bilinear<uint8_t, 4>(rect_pixels, table, unrect_pixels);
+            default: 
+                assert(false); // NOTE: blending is not appropriate for RS_FORMAT_Z16 (mixes depth across edges) or RS_FORMAT_YUYV images
+            }
+            return;
+        }
+
         switch(format)
         {
         case RS_FORMAT_Y8: 
-            return rectify_image_pixels((bytes<1> *)rect_pixels, rectification_table, (const bytes<1> *)unrect_pixels);
+            return rectify_image_pixels((bytes<1> *)rect_pixels, table, (const bytes<1> *)unrect_pixels);
         case RS_FORMAT_Y16: case RS_FORMAT_Z16: 
-            return rectify_image_pixels((bytes<2> *)rect_pixels, rectification_table, (const bytes<2> *)unrect_pixels);
+            return rectify_image_pixels((bytes<2> *)rect_pixels, table, (const bytes<2> *)unrect_pixels);
         case RS_FORMAT_RGB8: case RS_FORMAT_BGR8: 
-            return rectify_image_pixels((bytes<3> *)rect_pixels, rectification_table, (const bytes<3> *)unrect_pixels);
+            return rectify_image_pixels((bytes<3> *)rect_pixels, table, (const bytes<3> *)unrect_pixels);
         case RS_FORMAT_RGBA8: case RS_FORMAT_BGRA8: 
-            return rectify_image_pixels((bytes<4> *)rect_pixels, rectification_table, (const bytes<4> *)unrect_pixels);
+            return rectify_image_pixels((bytes<4> *)rect_pixels, table, (const bytes<4> *)unrect_pixels);
         default: 
             assert(false); // NOTE: rectify_image_pixels(...) is not appropriate for RS_FORMAT_YUYV images, no logic prevents U/V channels from being written to one another
         }
@@ -12,8 +12,18 @@ namespace rsimpl
 
     size_t           get_image_size                 (int width, int height, rs_format format);
     int              get_image_bpp                  (rs_format format);
-    void             deproject_z                    (float * points, const rs_intrinsics & z_intrin, const uint16_t * z_pixels, float z_scale);
-    void             deproject_disparity            (float * points, const rs_intrinsics & disparity_intrin, const uint16_t * disparity_pixels, float disparity_scale);
+
+    // Per-pixel (x/z, y/z) rays of a depth image, precomputed once per intrinsics so that deprojection is a multiply per pixel
+    struct deprojection_table
+    {
+        rs_intrinsics               intrin;
+        std::vector<float>          rays;           // x, y per pixel
+    };
+
+    std::shared_ptr<const deprojection_table>
+                     get_deprojection_table         (const rs_intrinsics & intrin);
+    void             deproject_z                    (float * points, const deprojection_table & z_rays, const uint16_t * z_pixels, float z_scale);
+    void             deproject_disparity            (float * points, const deprojection_table & disparity_rays, const uint16_t * disparity_pixels, float disparity_scale);
 
     void             align_z_to_other               (byte * z_aligned_to_other, const uint16_t * z_pixels, float z_scale, const rs_intrinsics & z_intrin, 
                                                      const rs_extrinsics & z_to_other, const rs_intrinsics & other_intrin);
@@ -24,8 +34,25 @@ namespace rsimpl
     void             align_other_to_disparity       (byte * other_aligned_to_disparity, const uint16_t * disparity_pixels, float disparity_scale, const rs_intrinsics & disparity_intrin, 
                                                      const rs_extrinsics & disparity_to_other, const rs_intrinsics & other_intrin, const byte * other_pixels, rs_format other_format);
 
+    enum class rect_interpolation { nearest, bilinear };
+
+    // Lookup table mapping every rectified pixel onto the unrectified image. Tables only depend on calibration,
+    // so they are cached and shared between all streams (and devices of the same model) that use the same one.
+    struct rectification_table
+    {
+        rs_intrinsics               rect_intrin, unrect_intrin;
+        rs_extrinsics               rect_to_unrect;
+        rect_interpolation          interpolation;
+        std::vector<int>            indices;        // Nearest (or top-left for bilinear) unrectified pixel index per rectified pixel
+        std::vector<uint16_t>       weights;        // Bilinear only, x and y fractions per rectified pixel in 1/256 units
+
+        bool                        matches(const rs_intrinsics & rect, const rs_extrinsics & extrin, const rs_intrinsics & unrect, rect_interpolation interp) const;
+    };
+
     std::vector<int> compute_rectification_table    (const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin);
-    void             rectify_image                  (uint8_t * rect_pixels, const std::vector<int> & rectification_table, const uint8_t * unrect_pixels, rs_format format);
+    std::shared_ptr<const rectification_table>
+                     get_rectification_table        (const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin, rect_interpolation interpolation);
+    void             rectify_image                  (uint8_t * rect_pixels, const rectification_table & table, const uint8_t * unrect_pixels, rs_format format);
 
     extern const native_pixel_format pf_raw8;       // Four 8 bit luminance
     extern const native_pixel_format pf_rw10;       // Four 10 bit luminance values in one 40 bit macropixel
@@ -159,15 +159,17 @@ const uint8_t * point_stream::get_frame_data() const
 {
     if(image.empty() || number != get_frame_number())
     {
-        image.resize(get_image_size(get_intrinsics().width, get_intrinsics().height, get_format()));
+        const auto intrin = get_intrinsics();
+        if(!rays || !(rays->intrin == intrin)) rays = get_deprojection_table(intrin);
+        image.resize(get_image_size(intrin.width, intrin.height, get_format()));
 
         if(source.get_format() == RS_FORMAT_Z16)
         {
-            deproject_z(reinterpret_cast<float *>(image.data()), get_intrinsics(), reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
+            deproject_z(reinterpret_cast<float *>(image.data()), *rays, reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
         }
         else if(source.get_format() == RS_FORMAT_DISPARITY16)
         {
-            deproject_disparity(reinterpret_cast<float *>(image.data()), get_intrinsics(), reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
+            deproject_disparity(reinterpret_cast<float *>(image.data()), *rays, reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
         }
         else assert(false && "Cannot deproject image from a non-depth format");
 
@@ -176,16 +178,23 @@ const uint8_t * point_stream::get_frame_data() const
     return image.data();
 }
 
+rectified_stream::rectified_stream(const stream_interface & source) : stream_interface(calibration_validator(), RS_STREAM_RECTIFIED_COLOR), source(source), interpolation(rect_interpolation::nearest), number() {}
+
 const uint8_t * rectified_stream::get_frame_data() const
 {
     // If source image is already rectified, just return it without doing any work
-    if(get_pose() == source.get_pose() && get_intrinsics() == source.get_intrinsics()) return source.get_frame_data();
+    const auto rect_intrin = get_intrinsics(), unrect_intrin = source.get_intrinsics();
+    if(get_pose() == source.get_pose() && rect_intrin == unrect_intrin) return source.get_frame_data();
 
     if(image.empty() || number != get_frame_number())
     {
-        if(table.empty()) table = compute_rectification_table(get_intrinsics(), get_extrinsics_to(source), source.get_intrinsics());
-        image.resize(get_image_size(get_intrinsics().width, get_intrinsics().height, get_format()));
-        rectify_image(image.data(), table, source.get_frame_data(), get_format());
+        // Depth is never blended, and the table is looked up again whenever the stream mode (and thus calibration) changes
+        const auto format = get_format();
+        const auto mode = format == RS_FORMAT_Z16 ? rect_interpolation::nearest : interpolation;
+        const auto rect_to_unrect = get_extrinsics_to(source);
+        if(!table || !table->matches(rect_intrin, rect_to_unrect, unrect_intrin, mode)) table = get_rectification_table(rect_intrin, rect_to_unrect, unrect_intrin, mode);
+        image.resize(get_image_size(rect_intrin.width, rect_intrin.height, format));
+        rectify_image(image.data(), *table, source.get_frame_data(), format);
         number = get_frame_number();
     }
     return image.data();
@@ -29,6 +29,9 @@ namespace rsimpl
     
     class frame_archive;
     class syncronizing_archive;
+    struct deprojection_table;
+    struct rectification_table;
+    enum class rect_interpolation;
 
     struct native_stream final : public stream_interface
     {
@@ -65,6 +68,7 @@ namespace rsimpl
     class point_stream final : public stream_interface
     {
         const stream_interface &                source;
+        mutable std::shared_ptr<const deprojection_table> rays;
         mutable std::vector<uint8_t>            image;
         mutable unsigned long long              number;
     public:
@@ -93,11 +97,15 @@ namespace rsimpl
     class rectified_stream final : public stream_interface
     {
         const stream_interface &                source;
-        mutable std::vector<int>                table;
+        rect_interpolation                      interpolation;
+        mutable std::shared_ptr<const rectification_table> table;
         mutable std::vector<uint8_t>            image;
         mutable unsigned long long              number;
     public:
-        rectified_stream(const stream_interface & source) : stream_interface(calibration_validator(), RS_STREAM_RECTIFIED_COLOR), source(source), number() {}
+        rectified_stream(const stream_interface & source);
+
+        void                                    set_interpolation(rect_interpolation value) { interpolation = value; }
+        rect_interpolation                      get_interpolation() const { return interpolation; }
 
         pose                                    get_pose() const override { return {{{1,0,0},{0,1,0},{0,0,1}}, source.get_pose().position}; }
         float                                   get_depth_scale() const override { return source.get_depth_scale(); }
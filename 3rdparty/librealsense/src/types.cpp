@@ -156,6 +156,7 @@ namespace rsimpl
         CASE(FISHEYE_EXTERNAL_TRIGGER)
         CASE(FRAMES_QUEUE_SIZE)
         CASE(TOTAL_FRAME_DROPS)
+        CASE(RECTIFIED_COLOR_INTERPOLATION)
         CASE(FISHEYE_ENABLE_AUTO_EXPOSURE)
         CASE(FISHEYE_AUTO_EXPOSURE_MODE)
         CASE(FISHEYE_AUTO_EXPOSURE_ANTIFLICKER_RATE)
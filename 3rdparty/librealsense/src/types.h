@@ -23,6 +23,9 @@
 #include <map>          
 #include <algorithm>
 #include <functional>
+#ifdef _MSC_VER
+#include <intrin.h>                         // For _BitScanForward64
+#endif
 
 const uint8_t RS_STREAM_NATIVE_COUNT    = 5;
 const int RS_USER_QUEUE_SIZE = 20;
@@ -486,46 +489,88 @@ namespace rsimpl
     }
 
     inline bool operator == (const rs_intrinsics & a, const rs_intrinsics & b) { return std::memcmp(&a, &b, sizeof(a)) == 0; }
+    inline bool operator == (const rs_extrinsics & a, const rs_extrinsics & b) { return std::memcmp(&a, &b, sizeof(a)) == 0; }
 
     inline uint32_t pack(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3)
     {
         return (c0 << 24) | (c1 << 16) | (c2 << 8) | c3;
     }
 
+    inline int lowest_set_bit(uint64_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    // Fixed-capacity pool shared by the USB and application threads. Slots are claimed and returned
+    // with atomic operations on a free-bitmap, the mutex is only taken to wake up wait_until_empty()
     template<class T, int C>
     class small_heap
     {
+        static const int WORDS = (C + 63) / 64;
+
         T buffer[C];
-        bool is_free[C];
+        std::atomic<uint64_t> free_bits[WORDS];
+        std::atomic<bool> keep_allocating;
+        std::atomic<int> size;
+        std::atomic<bool> waiting;
         std::mutex mutex;
-        bool keep_allocating = true;
         std::condition_variable cv;
-        int size = 0;
+
+        void release_count()
+        {
+            if (size.fetch_sub(1) == 1 && waiting.load())
+            {
+                // Pass through the mutex so the notification cannot slip in between the waiter's check and its wait
+                { std::lock_guard<std::mutex> lock(mutex); }
+                cv.notify_one();
+            }
+        }
 
     public:
-        small_heap()
+        small_heap() : keep_allocating(true), size(0), waiting(false)
         {
             for (auto i = 0; i < C; i++)
             {
-                is_free[i] = true;
                 buffer[i] = std::move(T());
             }
+            for (auto w = 0; w < WORDS; w++)
+            {
+                const int bits = std::min(C - w * 64, 64);
+                free_bits[w] = bits == 64 ? ~0ull : (1ull << bits) - 1;
+            }
         }
 
         T * allocate()
         {
-            std::unique_lock<std::mutex> lock(mutex);
-            if (!keep_allocating) return nullptr;
+            // The count is raised before checking the flag, so that stop_allocation() followed by
+            // wait_until_empty() either sees this allocation or makes it back off
+            size.fetch_add(1);
+            if (!keep_allocating.load())
+            {
+                release_count();
+                return nullptr;
+            }
 
-            for (auto i = 0; i < C; i++)
+            for (auto w = 0; w < WORDS; w++)
             {
-                if (is_free[i])
+                auto bits = free_bits[w].load(std::memory_order_relaxed);
+                while (bits)
                 {
-                    is_free[i] = false;
-                    size++;
-                    return &buffer[i];
+                    const auto index = lowest_set_bit(bits);
+                    if (free_bits[w].compare_exchange_weak(bits, bits & ~(1ull << index), std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        return &buffer[w * 64 + index];
+                    }
                 }
             }
+
+            release_count();
             return nullptr;
         }
 
@@ -537,34 +582,24 @@ namespace rsimpl
             }
             auto i = item - buffer;
             buffer[i] = std::move(T());
-            
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-
-                is_free[i] = true;
-                size--;
 
-                if (size == 0)
-                {
-                    lock.unlock();
-                    cv.notify_one();
-                }
-            }
+            free_bits[i / 64].fetch_or(1ull << (i % 64), std::memory_order_release);
+            release_count();
         }
 
         void stop_allocation()
         {
-            std::unique_lock<std::mutex> lock(mutex);
             keep_allocating = false;
         }
 
         void wait_until_empty()
         {
+            waiting = true;
             std::unique_lock<std::mutex> lock(mutex);
 
             const auto ready = [this]()
             {
-                return size == 0;
+                return size.load() == 0;
             };
             if (!ready() && !cv.wait_for(lock, std::chrono::hours(1000), ready)) // for some reason passing std::chrono::duration::max makes it return instantly
             {
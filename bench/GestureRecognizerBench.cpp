@@ -0,0 +1,90 @@
+// Cost of GestureRecognizer with 100 templates (40 swipes, 40 poses, 20 two-joint DTW sequences) over a simulated
+// crowd of 6 walking bodies at 30 Hz, one minute of frames. Prints the mean and worst time per frame.
+//
+// Needs Cinder like the block itself: build it as a console program out of this file, the block's src/*.cpp and
+// libcinder, e.g. from a Cinder project that uses the block with this file in place of the app's source.
+
+#include "GestureRecognizer.h"
+#include "SimulatedScene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ci;
+using namespace ds;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    const int kBodyCount = 6;
+    const double kFps = 30;
+    const int frameCount = argc > 1 ? atoi(argv[1]) : 60 * 30;
+
+    auto scene = SimulatedScene::createCrowd(kBodyCount, 1);
+
+    // Sequences are recorded from the crowd itself: both hands of one body over a second, in the body frame
+    vector<vector<vec3>> recorded;
+    for (int f = 0; f < 30; f++)
+    {
+        scene->update(f / kFps);
+        vec3 positions[Body::JOINT_COUNT];
+        if (GestureRecognizer::toBodyFrame(scene->bodies[0], positions))
+            recorded.push_back({positions[Body::HAND_RIGHT], positions[Body::HAND_LEFT]});
+    }
+    if (recorded.size() < 10)
+    {
+        printf("the simulated body has no usable spine\n");
+        return EXIT_FAILURE;
+    }
+
+    GestureRecognizer recognizer;
+    recognizer.setup();
+    for (int i = 0; i < 40; i++)
+    {
+        const Body::JointType hand = i % 2 ? Body::HAND_LEFT : Body::HAND_RIGHT;
+        recognizer.addTemplate(
+            GestureRecognizer::Template::swipe("swipe", hand, vec3(cos(i * 0.3f), sin(i * 0.3f), 0.2f)));
+    }
+    for (int i = 0; i < 40; i++)
+    {
+        recognizer.addTemplate(GestureRecognizer::Template::pose(
+            "pose", {{Body::HAND_LEFT, Body::HEAD, vec3(0, 1, 0), 0.1f * (i % 5), 10},
+                     {Body::HAND_RIGHT, Body::HIP_CENTER, vec3(1, 0, 0), -1, 0.3f},
+                     {Body::ELBOW_LEFT, Body::SHOULDER_LEFT, vec3(0, 0, 1), 0, 1}}));
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        // Different lengths and phases, so the sequences do not all match at once
+        vector<vector<vec3>> frames;
+        const size_t length = min(recorded.size(), (size_t)(10 + i));
+        for (size_t k = 0; k < length; k++)
+            frames.push_back(recorded[(k + i) % recorded.size()]);
+        recognizer.addTemplate(
+            GestureRecognizer::Template::sequence("sequence", {Body::HAND_RIGHT, Body::HAND_LEFT}, frames));
+    }
+
+    int events = 0;
+    recognizer.signalGesture.connect([&](const GestureRecognizer::Event&) { events++; });
+
+    double total = 0, worst = 0;
+    for (int f = 0; f < frameCount; f++)
+    {
+        const double seconds = 1 + f / kFps;
+        scene->update(seconds);
+
+        auto start = chrono::steady_clock::now();
+        recognizer.process(scene->bodies, seconds);
+        const double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        total += us;
+        worst = max(worst, us);
+    }
+
+    const double mean = total / frameCount;
+    printf("%d templates x %d bodies, %d frames: %.1f us per frame (worst %.1f us), %.3f%% of a %.0f Hz frame on one "
+           "core, %d events\n",
+           (int)recognizer.getTemplates().size(), kBodyCount, frameCount, mean, worst, mean * kFps / 1e4, kFps, events);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// RgbCamera pseudo-depth at 640x480 and 1920x1080, BGR and BGRA: the column-major getData({x, y}) loop that
+// DeviceRgbCamera::update used to run against convertToLuma16(). Prints the best of 40 runs of each and checks that
+// both produce the same depth. Exits non-zero on a mismatch.
+//
+// Needs Cinder like the block itself: build it as a console program out of this file, src/ColorKernels.cpp and
+// libcinder, e.g. from a Cinder project that uses the block with this file in place of the app's source.
+
+#include "ColorKernels.h"
+
+#include "cinder/Channel.h"
+#include "cinder/Surface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ci;
+using namespace ds;
+using namespace std;
+
+namespace
+{
+    const int kRuns = 40;
+
+    // The loop before convertToLuma16(), walking the surface column by column
+    void oldLoop(Channel16u& depthChannel, Surface8u& colorSurface)
+    {
+        const int kWidth = colorSurface.getWidth(), kHeight = colorSurface.getHeight();
+        for (int x = 0; x < kWidth; x++)
+            for (int y = 0; y < kHeight; y++)
+            {
+                uint16_t* dest = depthChannel.getData({x, y});
+                uint8_t* src = colorSurface.getData({x, y});
+                *dest = (src[0] + src[1] + src[2]) * 4; // 4 is magic number
+            }
+    }
+
+    void newKernel(Channel16u& depthChannel, const Surface8u& colorSurface)
+    {
+        const int channelOffsets[] = {colorSurface.getRedOffset(), colorSurface.getGreenOffset(),
+                                      colorSurface.getBlueOffset()};
+        const float weights[] = {1.0f, 1.0f, 1.0f};
+        convertToLuma16(depthChannel.getData(), depthChannel.getRowBytes(), colorSurface.getData(),
+                        colorSurface.getRowBytes(), colorSurface.getWidth(), colorSurface.getHeight(),
+                        colorSurface.getPixelInc(), channelOffsets, weights, 4.0f);
+    }
+
+    template <typename F>
+    double bestMicroseconds(F f)
+    {
+        double best = 1e30;
+        for (int r = 0; r < kRuns; r++)
+        {
+            const auto start = chrono::steady_clock::now();
+            f();
+            best = min(best, chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+} // namespace
+
+int main()
+{
+    const ivec2 sizes[] = {ivec2(640, 480), ivec2(1920, 1080)};
+    int failures = 0;
+    srand(3);
+    for (const ivec2& size : sizes)
+    {
+        for (bool hasAlpha : {false, true})
+        {
+            Surface8u colorSurface(size.x, size.y, hasAlpha,
+                                   hasAlpha ? SurfaceChannelOrder::BGRA : SurfaceChannelOrder::BGR);
+            for (int y = 0; y < size.y; y++)
+            {
+                uint8_t* row = colorSurface.getData({0, y});
+                for (int i = 0; i < size.x * colorSurface.getPixelInc(); i++)
+                    row[i] = (uint8_t)rand();
+            }
+            Channel16u oldDepth(size.x, size.y), newDepth(size.x, size.y);
+
+            const double oldTime = bestMicroseconds([&] { oldLoop(oldDepth, colorSurface); });
+            const double newTime = bestMicroseconds([&] { newKernel(newDepth, colorSurface); });
+
+            int mismatches = 0;
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++)
+                    mismatches += *oldDepth.getData({x, y}) != *newDepth.getData({x, y});
+            failures += mismatches != 0;
+
+            printf("%4dx%-4d %s: old loop %7.0f us, convertToLuma16 %6.0f us, %4.1fx, %d mismatches\n", size.x, size.y,
+                   hasAlpha ? "BGRA" : "BGR ", oldTime, newTime, oldTime / newTime, mismatches);
+        }
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
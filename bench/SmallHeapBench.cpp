@@ -0,0 +1,97 @@
+// Contention benchmark for rsimpl::small_heap, the pool behind librealsense's published frames,
+// framesets and detached frame refs. Every thread repeatedly takes a few slots and gives them back,
+// so with more than one core the threads fight over the same free bitmap words.
+//
+// Build from the repository root:
+//   g++ -std=c++11 -O2 -pthread -I3rdparty/librealsense/include -I3rdparty/librealsense/src bench/SmallHeapBench.cpp -o SmallHeapBench
+//   cl /EHsc /O2 /I3rdparty\librealsense\include /I3rdparty\librealsense\src bench\SmallHeapBench.cpp
+
+#include "types.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace rsimpl;
+
+namespace
+{
+	struct Item
+	{
+		int payload[8];
+	};
+
+	const int kHeapSize = 240;
+	const int kHeldPerIteration = 4;
+
+	// Returns nanoseconds per allocate + deallocate pair, averaged over all threads
+	double run(small_heap<Item, kHeapSize> & heap, int threadCount, int iterations, int & failures)
+	{
+		std::atomic<int> ready(0);
+		std::atomic<bool> go(false);
+		std::atomic<int> failed(0);
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&]
+			{
+				Item * held[kHeldPerIteration];
+				ready.fetch_add(1);
+				while (!go.load()) std::this_thread::yield();
+				for (int i = 0; i < iterations; ++i)
+				{
+					for (auto & item : held)
+					{
+						item = heap.allocate();
+						if (!item) failed.fetch_add(1);
+					}
+					for (auto item : held)
+					{
+						if (item) heap.deallocate(item);
+					}
+				}
+			});
+		}
+
+		while (ready.load() < threadCount) std::this_thread::yield();
+		auto start = std::chrono::steady_clock::now();
+		go = true;
+		for (auto & thread : threads) thread.join();
+		auto elapsed = std::chrono::steady_clock::now() - start;
+
+		failures = failed.load();
+		return std::chrono::duration<double, std::nano>(elapsed).count() / (double(iterations) * kHeldPerIteration);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+	const int cores = std::max(1, (int)std::thread::hardware_concurrency());
+
+	static small_heap<Item, kHeapSize> heap;
+
+	std::printf("small_heap<%d slots>, %d held per iteration, %d iterations per thread, %d hardware threads\n",
+		kHeapSize, kHeldPerIteration, iterations, cores);
+	if (cores == 1)
+	{
+		std::printf("warning: only one hardware thread, the CAS bitmap cannot be contended on this machine\n");
+	}
+
+	for (int threadCount = 1; threadCount <= std::max(4, cores * 2); threadCount *= 2)
+	{
+		int failures = 0;
+		double ns = run(heap, threadCount, iterations, failures);
+		// Wall time per pair across all threads; throughput is threadCount / ns pairs per nanosecond
+		std::printf("threads %2d: %7.1f ns per pair (wall), %7.1f ns per pair per thread, %d failed allocations\n",
+			threadCount, ns / threadCount, ns, failures);
+	}
+
+	heap.stop_allocation();
+	heap.wait_until_empty();
+	std::printf("after stop_allocation: allocate() returns %s\n", heap.allocate() ? "a slot (bug)" : "nullptr");
+	return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "DepthSensor.h"
+
+namespace ds
+{
+    // Structure-of-arrays copy of the joints of a set of bodies, for math over many bodies at once (smoothing,
+    // normalization, retargeting) without the strided loads of Body::joints.
+    //
+    // Arrays are joint-major: joint j of body b is element j * stride + b, so the same joint of every body is
+    // contiguous. stride is the body count rounded up to 4 and every row starts 16-byte aligned; padding lanes are
+    // zero and never read back into bodies.
+    struct BodyJoints
+    {
+        BodyJoints() = default;
+        BodyJoints(const BodyJoints&) = delete;
+        BodyJoints& operator=(const BodyJoints&) = delete;
+
+        // Reallocates only when bodies.size() outgrows every earlier call
+        void gather(const std::vector<Body>& bodies);
+
+        // Writes the arrays back into bodies gathered from, which must not have changed size
+        void scatter(std::vector<Body>* bodies) const;
+
+        // pos3d = m * pos3d and orientation = rotation of m * orientation. m is expected to be rigid.
+        void transform(const ci::mat4& m);
+
+        // pos2d of pos3d through a pinhole with y up in camera space and down in the image, in [0, 1] * [0, 1]
+        // coordinates like Body::Joint::pos2d; joints at z <= 0 get (0, 0)
+        void project(float fx, float fy, float cx, float cy, float width, float height);
+
+        // lengths[k * stride + b] = length of Body::bones[k] of body b, lengths holds BONE_COUNT * stride
+        void getBoneLengths(float* lengths) const;
+
+        size_t bodyCount = 0;
+        size_t stride = 0;
+        std::vector<uint64_t> ids;
+
+        // JOINT_COUNT * stride elements each
+        float *x = nullptr, *y = nullptr, *z = nullptr;            // pos3d
+        float *u = nullptr, *v = nullptr;                          // pos2d
+        float *qx = nullptr, *qy = nullptr, *qz = nullptr, *qw = nullptr; // orientation
+        uint8_t* confidence = nullptr;
+
+      private:
+        std::vector<float> storage;
+        std::vector<uint8_t> confidenceStorage;
+    };
+} // namespace ds
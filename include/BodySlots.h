@@ -0,0 +1,69 @@
+#pragma once
+
+#include "DepthSensor.h"
+
+#include <algorithm>
+
+namespace ds
+{
+    // Assigns the bodies of each frame to a fixed set of slots by tracking id, for per-body state kept in
+    // preallocated arrays (BodySmoother, JointHistory, GestureRecognizer). An id keeps its slot while it shows up in
+    // consecutive frames and frees it on the first frame it is missing. Bodies beyond the slot count get no slot.
+    // Allocates nothing once set up, for up to 32 bodies per frame.
+    //
+    // Per frame: match(bodies), then getSlot(b) and isNew(b) of each body.
+    struct BodySlots
+    {
+        void setup(size_t count)
+        {
+            ids.assign(count, 0);
+            isUsed.assign(count, 0);
+            isSeen.assign(count, 0);
+            bodySlots.reserve(std::max<size_t>(count, 32));
+            isBodyNew.reserve(std::max<size_t>(count, 32));
+        }
+
+        // Forgets every id, each one gets a new slot on its next match()
+        void reset() { std::fill(isUsed.begin(), isUsed.end(), 0); }
+
+        void match(const std::vector<Body>& bodies)
+        {
+            std::fill(isSeen.begin(), isSeen.end(), 0);
+            bodySlots.resize(bodies.size());
+            isBodyNew.resize(bodies.size());
+            for (size_t b = 0; b < bodies.size(); b++)
+            {
+                const uint64_t id = bodies[b].id;
+                int slot = -1;
+                for (size_t s = 0; s < ids.size() && slot < 0; s++)
+                    if (isUsed[s] && ids[s] == id && !isSeen[s])
+                        slot = (int)s;
+                for (size_t s = 0; s < ids.size() && slot < 0; s++)
+                    if (!isUsed[s] && !isSeen[s])
+                        slot = (int)s;
+
+                bodySlots[b] = slot;
+                isBodyNew[b] = slot >= 0 && !isUsed[slot];
+                if (slot >= 0)
+                {
+                    isSeen[slot] = 1;
+                    ids[slot] = id;
+                }
+            }
+            isUsed.swap(isSeen);
+        }
+
+        // Of bodies[b] in the last match(): its slot, -1 for none, and whether the slot was just claimed for it
+        int getSlot(size_t b) const { return bodySlots[b]; }
+        bool isNew(size_t b) const { return isBodyNew[b] != 0; }
+
+        uint64_t getId(size_t slot) const { return ids[slot]; }
+        size_t size() const { return ids.size(); }
+
+      private:
+        std::vector<uint64_t> ids;
+        std::vector<uint8_t> isUsed, isSeen;
+        std::vector<int> bodySlots;
+        std::vector<uint8_t> isBodyNew;
+    };
+} // namespace ds
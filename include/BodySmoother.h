@@ -0,0 +1,88 @@
+#pragma once
+
+#include "BodySlots.h"
+#include "DepthSensor.h"
+
+namespace ds
+{
+    // Filters pos3d and pos2d of every joint of a body stream. Filter state lives in preallocated
+    // structure-of-arrays buffers, one slot per tracking id. A slot is claimed when an id first shows up and freed
+    // as soon as it is missing from a frame. All joints of all slots are filtered in one pass.
+    //
+    // Measurements are weighted by joint confidence: a NONE joint holds (One-Euro) or coasts on its velocity
+    // (Kalman), LOW and MEDIUM ones pull less than HIGH ones. Orientations pass through unfiltered.
+    //
+    // Defaults assume the units of Body::Joint that every backend publishes: pos3d in meters, pos2d in [0, 1].
+    // They were tuned on SimulatedScene::createCrowd with 5 to 30 mm of joint noise, where One-Euro cuts the error
+    // of still bodies by 15-40% and stays below the raw error of walking ones. Kalman's constant velocity model
+    // lags behind swinging limbs, so by default it smooths only a few percent; lower processNoise for slow motion.
+    struct BodySmoother
+    {
+        enum Filter
+        {
+            ONE_EURO,     // adaptive low-pass, little lag on fast moves
+            KALMAN,       // constant velocity per axis
+        };
+
+        struct Options
+        {
+            Filter filter = ONE_EURO;
+            size_t maxBodies = 16; // ids beyond this many at once pass through unfiltered
+
+            // One-Euro: cutoff (Hz) = minCutoff + beta * |speed|, speed in meters/s filtered at derivativeCutoff
+            float minCutoff = 1.0f;
+            float beta = 40.0f;
+            float derivativeCutoff = 2.0f;
+
+            // Kalman: acceleration noise (meters/s^2) and measurement noise (meters) of a HIGH joint
+            float processNoise = 4.0f;
+            float measurementNoise = 0.005f;
+
+            // Approximate pos2d units per meter (about 0.25 for a body 2.5m from a 70 degree camera), so the same
+            // tuning applies to pos2d
+            float imageScale = 0.25f;
+
+            // Measurement weight by Body::JointConfidence
+            float confidenceWeights[Body::JOINT_CONFIDENCE_LEVELS_COUNT] = {0.0f, 0.3f, 0.7f, 1.0f};
+        };
+
+        void setup() { setup(Options()); }
+        void setup(const Options& options);
+
+        // Smooths device->bodies on every signalBodyDirty, ahead of slots connected at default priority. Time
+        // comes from device->bodyTimestamp, or the app clock when the backend leaves it at 0.
+        void attach(Device* device);
+        void detach();
+
+        // Smooths bodies in place, seconds is the capture time of this frame
+        void process(std::vector<Body>* bodies, double seconds);
+
+        // Forgets every id
+        void reset();
+
+        const Options& getOptions() const { return options; }
+
+      private:
+        enum
+        {
+            X,
+            Y,
+            Z,
+            U,
+            V,
+            CHANNEL_COUNT
+        };
+
+        Options options;
+        ci::signals::ScopedConnection connection;
+
+        size_t stride = 0;                // slots rounded up to 4, lane of joint j in slot s is j * stride + s
+        BodySlots slots;
+        std::vector<float> storage;       // every array below, 16-byte aligned
+        float* measurements[CHANNEL_COUNT] = {};
+        float* weights = nullptr;
+        // One-Euro: value, derivative. Kalman: position, velocity, covariance p00 p01 p11.
+        float* states[CHANNEL_COUNT][5] = {};
+        double lastSeconds = -1;
+    };
+} // namespace ds
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "DepthSensor.h"
+
+namespace ds
+{
+    // Compact binary body frames, one datagram per frame. Joint positions are quantized to positionStep, pos2d to
+    // 1/4096 and orientations to the three smallest quaternion components at 12 bits, each as a zigzag varint. A
+    // body present in the previous frame only sends differences to it, except on keyframes, so a decoder that missed
+    // a frame waits for the next keyframe.
+    //
+    // Layout, little endian: "db", version, flags (1 = keyframe), uint32 sequence, uint64 timestamp (us),
+    // float positionStep, uint8 body count, uint8 joint count, then per body: varint id, flags (1 = delta,
+    // 2 = confidences follow), uint64 of 2-bit confidences, and 8 varints per joint (x, y, z, u, v, then the
+    // orientation as a << 2 | largest component, b, c).
+    struct BodyEncoder
+    {
+        static const size_t kMaxBodies = 16;     // more bodies in a frame are not sent
+        static const size_t kMaxBytes = 65507;   // largest UDP payload
+
+        struct Options
+        {
+            float positionStep = 0.001f; // in units of pos3d, 1 mm with meters
+            int keyframeInterval = 30;   // in frames, bounds the time to recover from a lost datagram
+        };
+
+        void setup() { setup(Options()); }
+        void setup(const Options& options);
+
+        // Returns the size written to buffer, bodies that do not fit in capacity are left out
+        size_t encode(const std::vector<Body>& bodies, uint64_t timestamp, uint8_t* buffer, size_t capacity);
+
+        // The next frame is a keyframe
+        void reset();
+
+        const Options& getOptions() const { return options; }
+
+        // Quantized joints of a body, as both sides track them between frames
+        struct State
+        {
+            enum
+            {
+                X,
+                Y,
+                Z,
+                U,
+                V,
+                LARGEST, // index of the dropped quaternion component
+                A,
+                B,
+                C,
+                VALUE_COUNT
+            };
+
+            uint64_t id;
+            uint64_t confidences;
+            int32_t values[Body::JOINT_COUNT][VALUE_COUNT];
+        };
+
+      private:
+        Options options;
+        uint32_t sequence = 0;
+        int framesToKeyframe = 0;
+        State states[2][kMaxBodies];
+        size_t stateCounts[2] = {};
+        int previous = 0; // states[previous] holds the last frame sent
+    };
+
+    struct BodyDecoder
+    {
+        // Fills bodies (reusing its capacity) and timestamp, false for a frame that is malformed or follows a lost one,
+        // in which case bodies may be partly written
+        bool decode(const uint8_t* data, size_t size, std::vector<Body>* bodies, uint64_t* timestamp);
+
+        // Waits for the next keyframe
+        void reset();
+
+      private:
+        bool hasFrame = false;
+        uint32_t sequence = 0;
+        BodyEncoder::State states[2][BodyEncoder::kMaxBodies];
+        size_t stateCounts[2] = {};
+        int previous = 0;
+    };
+
+    // Sends every body frame to "udp://host:port" or "unix:///path/of/socket" (not on Windows). Nothing is allocated
+    // per frame once set up, and a missing receiver only drops datagrams.
+    struct BodyPublisher
+    {
+        struct Stats
+        {
+            uint64_t frames = 0;
+            uint64_t bodies = 0;
+            uint64_t bytes = 0;
+            uint64_t dropped = 0; // frames that did not fit or failed to send
+            double encodeSeconds = 0;
+
+            double getBytesPerBody() const { return bodies ? (double)bytes / bodies : 0; }
+            double getEncodeNanoseconds() const { return frames ? encodeSeconds * 1e9 / frames : 0; }
+        };
+
+        ~BodyPublisher() { close(); }
+
+        bool setup(const std::string& address) { return setup(address, BodyEncoder::Options()); }
+        bool setup(const std::string& address, const BodyEncoder::Options& options);
+        void close();
+
+        // Publishes device->bodies on every signalBodyDirty, after smoothers attached at a higher priority. Timestamps
+        // come from device->bodyTimestamp, or the app clock when the backend leaves it at 0.
+        void attach(Device* device);
+        void detach();
+
+        bool publish(const std::vector<Body>& bodies, uint64_t timestamp);
+
+        const Stats& getStats() const { return stats; }
+        void resetStats() { stats = Stats(); }
+
+      private:
+        BodyEncoder encoder;
+        std::vector<uint8_t> buffer;
+        intptr_t socket = -1;
+        uint8_t address[128];
+        int addressLength = 0;
+        Stats stats;
+        ci::signals::ScopedConnection connection;
+    };
+
+    // Binds the address a BodyPublisher sends to and decodes its frames without blocking
+    struct BodyReceiver
+    {
+        ~BodyReceiver() { close(); }
+
+        bool setup(const std::string& address);
+        void close();
+
+        // Decodes every datagram waiting, true if at least one frame made it into bodies
+        bool receive(std::vector<Body>* bodies, uint64_t* timestamp);
+
+      private:
+        BodyDecoder decoder;
+        std::vector<uint8_t> buffer;
+        std::vector<Body> decoded; // copied out only when a frame decodes
+        intptr_t socket = -1;
+        std::string unixPath; // removed on close
+    };
+} // namespace ds
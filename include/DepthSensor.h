@@ -1,4 +1,7 @@
+#pragma once
+
 #include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
 #include "cinder/Quaternion.h"
 #include "cinder/Surface.h"
 #include "cinder/Function.h"
@@ -8,6 +11,7 @@
 
 #define Simulator_Enabled
 #define RgbCamera_Enabled
+#define SharedMemory_Enabled
 
 #ifdef CINDER_MSW_DESKTOP
     //#define Kinect1_Enabled
@@ -81,6 +85,10 @@ namespace ds
             JOINT_COUNT,
         };
 
+        // Parent and child joint of each bone, from HIP_CENTER outwards. Face joints are not part of it.
+        static const int BONE_COUNT = 24;
+        static const JointType bones[BONE_COUNT][2];
+
         enum JointConfidence
         {
             JOINT_CONFIDENCE_NONE = 0,          /**< The joint is out of range (too far from depth camera) */
@@ -122,6 +130,43 @@ namespace ds
         bool enableInfrared = false;
         bool enableAudio = false;
         bool enableFace = false;
+
+        // RealSense only: depthChannel values (in mm) outside of [minDepth, maxDepth] are zeroed
+        uint16_t minDepth = 0;
+        uint16_t maxDepth = 0xFFFF;
+
+        // Capture modes, backends pick the closest one they support
+        enum ColorFormat
+        {
+            COLOR_BGRA, // decoded by the SDK
+            COLOR_MJPG, // compressed on the wire, decoded on worker threads
+            COLOR_NV12,
+            COLOR_YUY2,
+        };
+        ColorFormat colorFormat = COLOR_BGRA;
+        int colorWidth = 0; // 0 picks the backend default
+        int colorHeight = 0;
+        int colorDecodeScale = 1;     // 1, 2 or 4, colorSurface is 1 / colorDecodeScale of the captured size
+        int fps = 0;                  // 0 picks the backend default: 30, or unthrottled for RgbCamera
+        bool wideFieldOfView = false; // wide instead of narrow depth FOV
+        bool binnedDepth = false;     // 2x2 binned depth, half the resolution at a longer range
+
+        // Pseudo-depth of color-only devices (RgbCamera): dot(rgb, lumaWeights) * lumaGain
+        ci::vec3 lumaWeights = ci::vec3(1.0f);
+        float lumaGain = 4.0f;
+
+        // Simulator renders this scene instead of replaying a snapshot, keep a reference to read its ground truth
+        std::shared_ptr<struct SimulatedScene> simulatorScene;
+        int simulatorBodyCount = 0; // without a scene, > 0 renders SimulatedScene::createCrowd(count, seed)
+        uint32_t simulatorSeed = 0;
+
+        // Or loops over the depth*.png (16-bit, mm) and color*.png files of this directory at fps, in the order of
+        // the number at the end of each name. Depth and color with the same number form one frame.
+        ci::fs::path simulatorSequence;
+
+        // SharedMemory attaches to the FrameServer of this name, and stays invalid until one publishes a stream. Its
+        // channels and surfaces are read-only views into the server's memory, see Device::isFrameIntact().
+        std::string sharedMemoryName = "DepthSensor";
     };
 
     struct Device
@@ -139,6 +184,14 @@ namespace ds
             return 1.0f;
         }
 
+        // False once the frame whose getData() is data has been overwritten by its producer. Only SharedMemory
+        // publishes frames it does not own: never write into them, copy what is kept past the next update, and check
+        // this after reading one to drop a frame the server overwrote meanwhile.
+        virtual bool isFrameIntact(const void* /*data*/) const
+        {
+            return true;
+        }
+
         ci::Channel16u depthChannel;
         ci::signals::Signal<void()> signalDepthDirty;
 
@@ -154,6 +207,9 @@ namespace ds
         std::vector<Body> bodies;
         ci::signals::Signal<void()> signalBodyDirty;
 
+        // Device time (us) of the capture that bodies / bodyIndexChannel were computed from, 0 when unknown
+        uint64_t bodyTimestamp = 0;
+
         std::vector<Face> faces;
         ci::signals::Signal<void()> signalFaceDirty;
 
@@ -164,6 +220,19 @@ namespace ds
         ci::signals::Signal<void()> signalDepthToColorTableDirty;
         ci::Surface32f depthToColorTable;
 
+        // Backends that register on the host (Freenect2) resample depth to a pinhole camera and color onto that
+        // depth image. When these are published, the pointcloud tables above refer to undistortedDepthChannel.
+        ci::Channel16u undistortedDepthChannel;
+        ci::signals::Signal<void()> signalUndistortedDepthDirty;
+
+        // Color in the geometry of depthChannel (or undistortedDepthChannel when published)
+        ci::Surface8u registeredColorSurface;
+        ci::signals::Signal<void()> signalRegisteredColorDirty;
+
+        // Depth (in mm) in the geometry of colorSurface
+        ci::Channel16u registeredDepthChannel;
+        ci::signals::Signal<void()> signalRegisteredDepthDirty;
+
         ci::vec2 focalLength;
     };
 }
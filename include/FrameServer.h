@@ -0,0 +1,53 @@
+#pragma once
+
+#include "DepthSensor.h"
+
+#include <memory>
+
+namespace ds
+{
+    struct SharedMapping;
+
+    // Publishes every stream of a device into shared memory, for other processes to read through a SharedMemory
+    // device created with the same Option::sharedMemoryName. Each stream is a ring of slotCount frames, created at
+    // its first frame; setup() publishes what the device already holds. Publishing copies the frame once and never
+    // waits for clients. A client that keeps a frame while slotCount - 1 newer ones are published sees it overwritten.
+    struct FrameServer
+    {
+        struct Options
+        {
+            std::string name = "DepthSensor";
+            int slotCount = 4;
+        };
+
+        FrameServer();
+        ~FrameServer();
+
+        bool setup(const DeviceRef& device) { return setup(device, Options()); }
+        bool setup(const DeviceRef& device, const Options& options);
+
+        // Tells clients the server is gone and removes the shared memory
+        void close();
+
+        const Options& getOptions() const { return options; }
+
+      private:
+        // Copies the current frame of stream out of the device
+        void publish(int stream);
+        void publishImage(int stream, const void* data, int32_t width, int32_t height, ptrdiff_t rowBytes,
+                          int32_t pixelBytes, int32_t channelOrder, uint64_t timestamp);
+        void publishBodies();
+
+        // Shared memory of stream with at least slotBytes per frame, null if it can not be created
+        SharedMapping* getStream(int stream, size_t slotBytes);
+
+        DeviceRef device;
+        Options options;
+        std::vector<ci::signals::ScopedConnection> connections;
+        std::vector<std::unique_ptr<SharedMapping>> streams;
+        std::vector<std::unique_ptr<SharedMapping>> directories; // name the current object of each stream
+        std::vector<uint8_t> isStreamFailed;
+        std::vector<uint64_t> generations; // of the current object of each stream
+        uint64_t serverId = 0;
+    };
+} // namespace ds
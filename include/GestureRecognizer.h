@@ -0,0 +1,152 @@
+#pragma once
+
+#include "BodySlots.h"
+#include "DepthSensor.h"
+
+namespace ds
+{
+    // Detects gestures of every tracked body against a set of templates, updating each template incrementally with
+    // every frame rather than re-scanning a window of history.
+    //
+    // Joints are compared in a body frame: origin at SHOULDER_CENTER, x to the body's right, y up the spine, z out of
+    // the chest, scaled so that HIP_CENTER to SHOULDER_CENTER is 0.5 long. Template distances are thus about meters
+    // on an adult, whatever the build of the body or the units of the backend.
+    //
+    // Templates are compiled into structure-of-arrays lanes, so one frame of one body evaluates all motion and pose
+    // constraints four at a time, and all dynamic time warping columns with one SIMD pass plus a scalar prefix min.
+    struct GestureRecognizer
+    {
+        // minimum <= dot(joint - reference, axis) <= maximum
+        struct Constraint
+        {
+            Body::JointType joint, reference;
+            ci::vec3 axis;
+            float minimum, maximum;
+        };
+
+        struct Template
+        {
+            enum Kind
+            {
+                MOTION,   // joint travels distance along direction, relative to reference, within duration
+                POSE,     // every constraint holds for duration
+                SEQUENCE, // joints follow frames, matched by subsequence dynamic time warping
+            };
+
+            std::string name;
+            Kind kind = POSE;
+            float cooldown = 0.5f; // seconds before the same body can trigger it again
+
+            Body::JointType joint = Body::HAND_RIGHT, reference = Body::SHOULDER_CENTER;
+            ci::vec3 direction;
+            float distance = 0;
+            float duration = 0;
+
+            std::vector<Constraint> constraints;
+
+            // frames[i][k] is joints[k] in body frame coordinates (see toBodyFrame), fires when the warped RMS
+            // distance per joint drops to threshold
+            std::vector<Body::JointType> joints;
+            std::vector<std::vector<ci::vec3>> frames;
+            float threshold = 0.1f;
+
+            static Template swipe(const std::string& name, Body::JointType hand, const ci::vec3& direction,
+                                  float distance = 0.4f, float duration = 0.6f);
+            static Template push(const std::string& name, Body::JointType hand, float distance = 0.3f,
+                                 float duration = 0.5f);
+            // hand above the head by height
+            static Template raise(const std::string& name, Body::JointType hand, float height = 0.1f,
+                                  float duration = 0.3f);
+            static Template pose(const std::string& name, const std::vector<Constraint>& constraints,
+                                 float duration = 0.3f);
+            static Template sequence(const std::string& name, const std::vector<Body::JointType>& joints,
+                                     const std::vector<std::vector<ci::vec3>>& frames, float threshold = 0.1f);
+        };
+
+        struct Event
+        {
+            uint64_t bodyId;
+            size_t gesture; // index returned by addTemplate
+            double seconds;
+            float score;    // distance travelled, seconds held or RMS distance of the match
+        };
+
+        struct Options
+        {
+            size_t maxBodies = 16; // ids beyond this many at once are ignored
+        };
+
+        void setup() { setup(Options()); }
+        void setup(const Options& options);
+
+        // Templates can change at any time from the processing thread, which resets every body
+        size_t addTemplate(const Template& gesture);
+        void clearTemplates();
+        const std::vector<Template>& getTemplates() const { return templates; }
+
+        // Processes device->bodies on every signalBodyDirty, after smoothers attached at a higher priority. Time
+        // comes from device->bodyTimestamp, or the app clock when the backend leaves it at 0.
+        void attach(Device* device);
+        void detach();
+
+        // seconds is the capture time of this frame, events are emitted from here
+        void process(const std::vector<Body>& bodies, double seconds);
+
+        // Forgets every id
+        void reset();
+
+        ci::signals::Signal<void(const Event&)> signalGesture;
+
+        // Every joint of body in the body frame, false when its spine is degenerate
+        static bool toBodyFrame(const Body& body, ci::vec3* positions);
+
+      private:
+        void compile();
+        void claimSlot(size_t slot, float seconds);
+        void emit(size_t slot, size_t gesture, float seconds, float score);
+
+        Options options;
+        ci::signals::ScopedConnection connection;
+        std::vector<Template> templates;
+        bool isCompiled = false;
+        double epoch = -1; // process() time of the first frame, state keeps float seconds since
+
+        BodySlots slots;
+
+        std::vector<float> storage; // every float array below, 16-byte aligned
+        float* features[3] = {};    // body frame x, y, z of each joint of the body being processed
+
+        // Motion and pose constraint lanes, each padded to 4, lanes of a template are contiguous
+        struct Lanes
+        {
+            size_t count = 0, stride = 0;
+            std::vector<int> joints, references, gestures;
+            float *axisX = nullptr, *axisY = nullptr, *axisZ = nullptr;
+            float *minimum = nullptr, *maximum = nullptr;
+            float *values = nullptr; // of the body being processed
+        };
+        Lanes motion, pose;
+        float *motionStart = nullptr, *motionStartSeconds = nullptr; // [slot * motion.stride + lane]
+        std::vector<size_t> poseBegin;                                // per POSE template, into pose lanes
+        std::vector<size_t> poseGestures;
+        float* poseHoldSeconds = nullptr;                             // [slot * poseGestures.size() + i], -1 idle
+        std::vector<uint8_t> isPoseFired;
+
+        // Sequence template points, per template and joint a block of frames padded to 4
+        struct Sequence
+        {
+            size_t gesture, length, stride;
+            size_t joints, firstJoint;      // blocks, and where their joints start in sequenceJoints
+            size_t points;                  // offset of the first block in pointX/Y/Z
+            size_t column;                  // offset in the columns of a slot
+        };
+        std::vector<Sequence> sequences;
+        std::vector<int> sequenceJoints;
+        float *pointX = nullptr, *pointY = nullptr, *pointZ = nullptr;
+        float *distances = nullptr, *steps = nullptr; // per frame of the longest sequence, for the body being processed
+        float* columns = nullptr;           // [slot * columnStride + column], a leading 0 then one per frame
+        size_t columnStride = 0;
+
+        std::vector<float> lastFired;       // [slot * templates.size() + gesture]
+    };
+} // namespace ds
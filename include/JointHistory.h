@@ -0,0 +1,99 @@
+#pragma once
+
+#include "BodySlots.h"
+#include "DepthSensor.h"
+
+#include <atomic>
+
+namespace ds
+{
+    // Last few seconds of every joint of every tracked body, in memory allocated once by setup(). Bodies are kept in
+    // stable slots keyed by tracking id, and a new id starts an empty history.
+    //
+    // One thread pushes frames (usually the device thread via attach()), any number of threads may query at the same
+    // time without locks: a query that raced with the writer overwriting the samples it read is retried.
+    // Queries take sample counts rather than durations so they stay O(1), use getSamples() to window by time.
+    struct JointHistory
+    {
+        struct Options
+        {
+            size_t maxBodies = 16; // ids beyond this many at once are not recorded
+            size_t capacity = 256; // samples kept per body, about 8 seconds at 30 fps
+        };
+
+        // Over the newest samples of a joint
+        struct Stats
+        {
+            size_t count = 0;
+            ci::vec3 mean;
+            ci::vec3 variance;
+        };
+
+        void setup() { setup(Options()); }
+        void setup(const Options& options);
+
+        // Records device->bodies on every signalBodyDirty, after smoothers attached at a higher priority. Time comes
+        // from device->bodyTimestamp, or the app clock when the backend leaves it at 0.
+        void attach(Device* device);
+        void detach();
+
+        // Writer thread only, seconds is the capture time of this frame
+        void push(const std::vector<Body>& bodies, double seconds);
+
+        // Writer thread only, forgets every id
+        void reset();
+
+        // Ids in the newest frame, returns how many were written
+        size_t getIds(uint64_t* ids, size_t maxCount) const;
+
+        // Samples recorded for id since it appeared, at most capacity
+        size_t getSampleCount(uint64_t id) const;
+
+        // age 0 is the newest sample. Each returns false when id is gone or has too few samples.
+        bool getPosition(uint64_t id, int joint, ci::vec3* position, size_t age = 0) const;
+        // Backward difference of the samples at age and age + 1, in meters/s
+        bool getVelocity(uint64_t id, int joint, ci::vec3* velocity, size_t age = 0) const;
+        // Second difference of the samples at age to age + 2, in meters/s^2
+        bool getAcceleration(uint64_t id, int joint, ci::vec3* acceleration, size_t age = 0) const;
+        // Over the newest window samples, or all of them if there are fewer
+        bool getStats(uint64_t id, int joint, size_t window, Stats* stats) const;
+
+        // Up to maxCount newest samples oldest first, either output may be null. Returns how many were written.
+        size_t getSamples(uint64_t id, int joint, size_t maxCount, ci::vec3* positions, double* seconds) const;
+
+        const Options& getOptions() const { return options; }
+
+      private:
+        struct Sample
+        {
+            ci::vec3 position;
+            double sum[3];   // of positions since the id appeared, so window sums are one subtraction
+            double sumSq[3];
+        };
+
+        template <typename Reader>
+        bool read(uint64_t id, Reader reader) const;
+
+        Sample& at(uint64_t frame, size_t slot, int joint)
+        {
+            return samples[((frame % frameCapacity) * options.maxBodies + slot) * Body::JOINT_COUNT + joint];
+        }
+        const Sample& at(uint64_t frame, size_t slot, int joint) const
+        {
+            return samples[((frame % frameCapacity) * options.maxBodies + slot) * Body::JOINT_COUNT + joint];
+        }
+
+        Options options;
+        size_t frameCapacity = 0; // one more than options.capacity, so a window always has the sample ahead of it
+        ci::signals::ScopedConnection connection;
+
+        BodySlots slots; // writer side
+
+        // Ring of frames, frame n lives at n % frameCapacity. Per frame and slot: the id and the frame it appeared in.
+        std::vector<double> frameSeconds;
+        std::vector<uint64_t> frameIds, frameFirsts;
+        std::vector<Sample> samples;
+        std::atomic<uint64_t> frameCount{0}; // frames published
+        std::atomic<uint64_t> frameWriting{0}; // frame being (or last) written, invalidates frameWriting - frameCapacity
+    };
+} // namespace ds
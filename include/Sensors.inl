@@ -25,3 +25,6 @@ ITEM(Imi, 6)
 #ifdef KinectAzure_Enabled
 ITEM(KinectAzure, 7)
 #endif
+#ifdef SharedMemory_Enabled
+ITEM(SharedMemory, 8)
+#endif
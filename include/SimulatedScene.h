@@ -0,0 +1,137 @@
+#pragma once
+
+#include "DepthSensor.h"
+
+namespace ds
+{
+    // Parametric scene for DeviceSimulator to ray cast: a floor, a back wall, moving boxes and spheres, and people
+    // walking as capsule figures. The pose is a function of the time given to update() and the image noise of the
+    // frame index given to render(), so a seed, a time and an index reproduce a frame exactly. primitives and
+    // bodies are the noise-free ground truth to compare processed output against.
+    //
+    // Camera space is that of Body::Joint::pos3d: meters, camera at the origin looking down +z, y up.
+    struct SimulatedScene
+    {
+        // Pinhole camera shared by depth, IR, color and body index
+        struct Camera
+        {
+            int width = 640, height = 480;
+            float fx = 0, fy = 0, cx = 0, cy = 0;
+
+            void setup(int width, int height, float horizontalFovDegrees = 70.0f);
+
+            // Pixel (px, py) sees (ray.x, ray.y, 1) * z
+            ci::vec2 getRay(int px, int py) const { return {(px + 0.5f - cx) / fx, (cy - py - 0.5f) / fy}; }
+
+            // Into [0, 1] x [0, 1] image coordinates, like Body::Joint::pos2d
+            ci::vec2 project(const ci::vec3& p) const
+            {
+                return {(cx + fx * p.x / p.z) / width, (cy - fy * p.y / p.z) / height};
+            }
+        };
+
+        struct Primitive
+        {
+            enum Type
+            {
+                SPHERE,
+                BOX,
+                CAPSULE,
+            };
+
+            Type type = SPHERE;
+            ci::vec3 a, b;           // sphere: center, box: center and half size, capsule: end points
+            float radius = 0;        // sphere and capsule radius, box rotation about y in radians
+            ci::vec3 color{0.5f};    // rgb in [0, 1], its luminance doubles as IR albedo
+            uint8_t bodyIndex = 255; // index into bodies, 255 for props
+        };
+
+        // Moves by amplitude * sin(2 pi frequency t + phase) around its placement, boxes also turn by spin rad/s
+        struct Prop
+        {
+            Primitive shape;
+            ci::vec3 amplitude;
+            float frequency = 0, phase = 0, spin = 0;
+        };
+
+        // Walks back and forth between two points on the floor
+        struct Walker
+        {
+            ci::vec2 from, to; // x, z
+            float height = 1.75f, speed = 1.2f;
+            float phase = 0; // start offset, as a fraction of the way
+            ci::vec3 shirt{0.2f, 0.3f, 0.7f}, pants{0.2f}, skin{0.8f, 0.6f, 0.5f};
+            uint64_t id = 0;
+        };
+
+        struct Hit
+        {
+            float z = 0;
+            ci::vec3 normal, color;
+            uint8_t bodyIndex = 255;
+        };
+
+        // Outputs of render(), packed at camera size; null ones are skipped
+        struct Frame
+        {
+            uint16_t* depth = nullptr; // mm
+            uint16_t* infrared = nullptr;
+            uint8_t* color = nullptr; // BGRX
+            uint8_t* bodyIndex = nullptr;
+        };
+
+        // Floor, wall, four props and two walkers, placed and colored by seed
+        static std::shared_ptr<SimulatedScene> createDefault(uint32_t seed = 0);
+
+        // Up to kMaxCrowd walkers crossing the view in rows, for body pipeline load tests
+        static const int kMaxCrowd = 64;
+        static std::shared_ptr<SimulatedScene> createCrowd(int bodyCount, uint32_t seed = 0);
+
+        // Poses props and walkers at the given time into primitives and bodies. bodies[i] is walker i and
+        // bodyIndex i, its joints are NONE when out of view and LOW when hidden by another surface.
+        void update(double seconds);
+
+        // Ray casts the posed scene. Each primitive is only tested within its screen bounds, so the cost grows
+        // with covered pixels rather than with pixels times primitives. Returns right away when frame is empty,
+        // bodies alone come from update().
+        void render(const Frame& frame, uint64_t frameIndex) const;
+
+        // Noise-free closest hit along (ray.x, ray.y, 1), floor and wall included
+        bool intersect(const ci::vec2& ray, Hit* hit) const;
+
+        Camera camera;
+        float floorHeight = 1.0f; // of the camera, above the floor
+        float wallDistance = 5.0f;
+        float depthNoise = 0; // depth noise sigma in mm at 1 m, grows with z^2
+        float holeRate = 0;   // fraction of depth pixels dropped at random, on top of grazing surfaces
+        uint32_t seed = 0;
+
+        std::vector<Prop> props;
+        std::vector<Walker> walkers;
+
+        // Output of update()
+        double time = 0;
+        std::vector<Primitive> primitives;
+        std::vector<Body> bodies;
+
+      private:
+        void addWalker(const Walker& walker, uint8_t bodyIndex);
+        void updateConfidences();
+        bool isOccluded(const ci::vec3& point) const;
+        // Normal, color and body index of the surface with the given id (a primitive, the wall or the floor)
+        void getSurface(const ci::vec3& point, int id, Hit* hit) const;
+
+        // primitives[begin, end) of each body and a sphere around them
+        struct BodyBounds
+        {
+            size_t begin, end;
+            ci::vec3 center;
+            float radius;
+        };
+        std::vector<BodyBounds> bodyBounds;
+
+        // render() scratch: closest z and primitive per pixel
+        mutable std::vector<float> zBuffer;
+        mutable std::vector<int> idBuffer;
+    };
+} // namespace ds
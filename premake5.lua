@@ -16,6 +16,9 @@ solution "OpenDepthSensor"
 
         cppdialect "C++11"
 
+        -- image kernels are parallelized with omp pragmas
+        openmp "On"
+
         disablewarnings {
             "4244",
             "4305",
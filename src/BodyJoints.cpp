@@ -0,0 +1,195 @@
+#include "BodyJoints.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static const int kFloatArrays = 9; // x y z u v qx qy qz qw
+
+    void BodyJoints::gather(const vector<Body>& bodies)
+    {
+        bodyCount = bodies.size();
+        stride = (bodyCount + 3) & ~size_t(3);
+        const size_t count = Body::JOINT_COUNT * stride;
+
+        // one block for every float array, offset to a 16-byte boundary
+        if (storage.size() < count * kFloatArrays + 3)
+            storage.resize(count * kFloatArrays + 3);
+        float* base = storage.data();
+        base += ((16 - (uintptr_t)base % 16) % 16) / sizeof(float);
+        float** arrays[kFloatArrays] = {&x, &y, &z, &u, &v, &qx, &qy, &qz, &qw};
+        for (int i = 0; i < kFloatArrays; i++)
+            *arrays[i] = base + i * count;
+        if (confidenceStorage.size() < count)
+            confidenceStorage.resize(count);
+        confidence = confidenceStorage.data();
+
+        ids.resize(bodyCount);
+        for (size_t b = 0; b < bodyCount; b++)
+            ids[b] = bodies[b].id;
+
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            const size_t row = j * stride;
+            for (size_t b = 0; b < bodyCount; b++)
+            {
+                const auto& joint = bodies[b].joints[j];
+                x[row + b] = joint.pos3d.x;
+                y[row + b] = joint.pos3d.y;
+                z[row + b] = joint.pos3d.z;
+                u[row + b] = joint.pos2d.x;
+                v[row + b] = joint.pos2d.y;
+                qx[row + b] = joint.orientation.x;
+                qy[row + b] = joint.orientation.y;
+                qz[row + b] = joint.orientation.z;
+                qw[row + b] = joint.orientation.w;
+                confidence[row + b] = (uint8_t)joint.confidence;
+            }
+            for (size_t b = bodyCount; b < stride; b++)
+            {
+                for (int i = 0; i < kFloatArrays; i++)
+                    (*arrays[i])[row + b] = 0;
+                confidence[row + b] = 0;
+            }
+        }
+    }
+
+    void BodyJoints::scatter(vector<Body>* bodies) const
+    {
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            const size_t row = j * stride;
+            for (size_t b = 0; b < bodyCount; b++)
+            {
+                auto& joint = (*bodies)[b].joints[j];
+                joint.pos3d = vec3(x[row + b], y[row + b], z[row + b]);
+                joint.pos2d = vec2(u[row + b], v[row + b]);
+                joint.orientation = quat(qw[row + b], qx[row + b], qy[row + b], qz[row + b]);
+                joint.confidence = (Body::JointConfidence)confidence[row + b];
+            }
+        }
+    }
+
+    void BodyJoints::transform(const mat4& m)
+    {
+        const size_t count = Body::JOINT_COUNT * stride;
+        const quat r = glm::quat_cast(m);
+        size_t i = 0;
+
+#ifdef DS_USE_SSE2
+        {
+            __m128 m00 = _mm_set1_ps(m[0][0]), m01 = _mm_set1_ps(m[1][0]), m02 = _mm_set1_ps(m[2][0]);
+            __m128 m10 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m12 = _mm_set1_ps(m[2][1]);
+            __m128 m20 = _mm_set1_ps(m[0][2]), m21 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]);
+            __m128 t0 = _mm_set1_ps(m[3][0]), t1 = _mm_set1_ps(m[3][1]), t2 = _mm_set1_ps(m[3][2]);
+            __m128 rw = _mm_set1_ps(r.w), rx = _mm_set1_ps(r.x), ry = _mm_set1_ps(r.y), rz = _mm_set1_ps(r.z);
+            for (; i < count; i += 4)
+            {
+                __m128 px = _mm_load_ps(x + i), py = _mm_load_ps(y + i), pz = _mm_load_ps(z + i);
+                _mm_store_ps(x + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m01, py)),
+                                               _mm_add_ps(_mm_mul_ps(m02, pz), t0)));
+                _mm_store_ps(y + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, px), _mm_mul_ps(m11, py)),
+                                               _mm_add_ps(_mm_mul_ps(m12, pz), t1)));
+                _mm_store_ps(z + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, px), _mm_mul_ps(m21, py)),
+                                               _mm_add_ps(_mm_mul_ps(m22, pz), t2)));
+
+                // r * q
+                __m128 ow = _mm_load_ps(qw + i), ox = _mm_load_ps(qx + i);
+                __m128 oy = _mm_load_ps(qy + i), oz = _mm_load_ps(qz + i);
+                _mm_store_ps(qw + i, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(rw, ow), _mm_mul_ps(rx, ox)),
+                                                _mm_add_ps(_mm_mul_ps(ry, oy), _mm_mul_ps(rz, oz))));
+                _mm_store_ps(qx + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, ox), _mm_mul_ps(rx, ow)),
+                                                _mm_sub_ps(_mm_mul_ps(ry, oz), _mm_mul_ps(rz, oy))));
+                _mm_store_ps(qy + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, oy), _mm_mul_ps(rx, oz)),
+                                                _mm_add_ps(_mm_mul_ps(ry, ow), _mm_mul_ps(rz, ox))));
+                _mm_store_ps(qz + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, oz), _mm_mul_ps(rx, oy)),
+                                                _mm_sub_ps(_mm_mul_ps(rz, ow), _mm_mul_ps(ry, ox))));
+            }
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            const float px = x[i], py = y[i], pz = z[i];
+            x[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+            y[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+            z[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+
+            const float ow = qw[i], ox = qx[i], oy = qy[i], oz = qz[i];
+            qw[i] = r.w * ow - r.x * ox - r.y * oy - r.z * oz;
+            qx[i] = r.w * ox + r.x * ow + r.y * oz - r.z * oy;
+            qy[i] = r.w * oy - r.x * oz + r.y * ow + r.z * ox;
+            qz[i] = r.w * oz + r.x * oy - r.y * ox + r.z * ow;
+        }
+    }
+
+    void BodyJoints::project(float fx, float fy, float cx, float cy, float width, float height)
+    {
+        const size_t count = Body::JOINT_COUNT * stride;
+        const float su = fx / width, sv = fy / height, ou = cx / width, ov = cy / height;
+        size_t i = 0;
+
+#ifdef DS_USE_SSE2
+        {
+            const __m128 vsu = _mm_set1_ps(su), vsv = _mm_set1_ps(sv), vou = _mm_set1_ps(ou), vov = _mm_set1_ps(ov);
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            for (; i < count; i += 4)
+            {
+                __m128 pz = _mm_load_ps(z + i);
+                __m128 isValid = _mm_cmpgt_ps(pz, zero);
+                // invalid lanes divide by one and are masked to 0 afterwards
+                __m128 invZ = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(isValid, pz), _mm_andnot_ps(isValid, one)));
+                __m128 pu = _mm_add_ps(vou, _mm_mul_ps(vsu, _mm_mul_ps(_mm_load_ps(x + i), invZ)));
+                __m128 pv = _mm_sub_ps(vov, _mm_mul_ps(vsv, _mm_mul_ps(_mm_load_ps(y + i), invZ)));
+                _mm_store_ps(u + i, _mm_and_ps(isValid, pu));
+                _mm_store_ps(v + i, _mm_and_ps(isValid, pv));
+            }
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            if (z[i] > 0)
+            {
+                u[i] = ou + su * x[i] / z[i];
+                v[i] = ov - sv * y[i] / z[i];
+            }
+            else
+            {
+                u[i] = v[i] = 0;
+            }
+        }
+    }
+
+    void BodyJoints::getBoneLengths(float* lengths) const
+    {
+        for (int k = 0; k < Body::BONE_COUNT; k++)
+        {
+            const size_t from = Body::bones[k][0] * stride, to = Body::bones[k][1] * stride;
+            float* dst = lengths + k * stride;
+            size_t b = 0;
+
+#ifdef DS_USE_SSE2
+            for (; b < stride; b += 4)
+            {
+                __m128 dx = _mm_sub_ps(_mm_load_ps(x + to + b), _mm_load_ps(x + from + b));
+                __m128 dy = _mm_sub_ps(_mm_load_ps(y + to + b), _mm_load_ps(y + from + b));
+                __m128 dz = _mm_sub_ps(_mm_load_ps(z + to + b), _mm_load_ps(z + from + b));
+                __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                _mm_storeu_ps(dst + b, _mm_sqrt_ps(d2));
+            }
+#endif
+
+            for (; b < stride; b++)
+            {
+                float dx = x[to + b] - x[from + b], dy = y[to + b] - y[from + b], dz = z[to + b] - z[from + b];
+                dst[b] = sqrt(dx * dx + dy * dy + dz * dz);
+            }
+        }
+    }
+} // namespace ds
@@ -0,0 +1,232 @@
+#include "BodySmoother.h"
+#include "Simd.h"
+
+#include "cinder/app/App.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static const float kTwoPi = 6.2831853f;
+
+    // value += (measurement - value) * alpha(cutoff) * weight, with the cutoff raised by the filtered speed
+    static void filterOneEuro(float* value, float* derivative, const float* measurement, const float* weight,
+                              size_t count, float dt, float minCutoff, float beta, float derivativeCutoff)
+    {
+        const float rate = 1.0f / dt;
+        const float c = kTwoPi * derivativeCutoff * dt;
+        const float derivativeAlpha = c / (c + 1.0f);
+        size_t i = 0;
+
+#ifdef DS_USE_SSE2
+        const __m128 vRate = _mm_set1_ps(rate), vDerivativeAlpha = _mm_set1_ps(derivativeAlpha);
+        const __m128 vMinCutoff = _mm_set1_ps(kTwoPi * dt * minCutoff), vBeta = _mm_set1_ps(kTwoPi * dt * beta);
+        const __m128 one = _mm_set1_ps(1.0f), absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        for (; i < count; i += 4)
+        {
+            __m128 x = _mm_load_ps(value + i), w = _mm_load_ps(weight + i);
+            __m128 dx = _mm_load_ps(derivative + i);
+            __m128 delta = _mm_sub_ps(_mm_load_ps(measurement + i), x);
+            // the derivative only follows what the measurement is trusted for
+            dx = _mm_add_ps(dx, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(delta, vRate), dx), _mm_mul_ps(vDerivativeAlpha, w)));
+            __m128 cutoff = _mm_add_ps(vMinCutoff, _mm_mul_ps(vBeta, _mm_and_ps(dx, absMask)));
+            __m128 alpha = _mm_div_ps(cutoff, _mm_add_ps(cutoff, one));
+            _mm_store_ps(value + i, _mm_add_ps(x, _mm_mul_ps(delta, _mm_mul_ps(alpha, w))));
+            _mm_store_ps(derivative + i, dx);
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            const float w = weight[i];
+            const float delta = measurement[i] - value[i];
+            derivative[i] += (delta * rate - derivative[i]) * derivativeAlpha * w;
+            const float cutoff = kTwoPi * dt * (minCutoff + beta * abs(derivative[i]));
+            value[i] += delta * cutoff / (cutoff + 1.0f) * w;
+        }
+    }
+
+    // Predict with constant velocity, then update with a measurement variance of r / weight (no update at 0)
+    static void filterKalman(float* position, float* velocity, float* p00, float* p01, float* p11,
+                             const float* measurement, const float* weight, size_t count, float dt, float q, float r)
+    {
+        // white acceleration noise integrated over dt
+        const float q00 = q * dt * dt * dt / 3.0f, q01 = q * dt * dt / 2.0f, q11 = q * dt;
+        size_t i = 0;
+
+#ifdef DS_USE_SSE2
+        const __m128 vDt = _mm_set1_ps(dt), vQ00 = _mm_set1_ps(q00), vQ01 = _mm_set1_ps(q01),
+                     vQ11 = _mm_set1_ps(q11), vR = _mm_set1_ps(r), zero = _mm_setzero_ps();
+        for (; i < count; i += 4)
+        {
+            __m128 x = _mm_load_ps(position + i), v = _mm_load_ps(velocity + i);
+            __m128 a = _mm_load_ps(p00 + i), b = _mm_load_ps(p01 + i), d = _mm_load_ps(p11 + i);
+            __m128 w = _mm_load_ps(weight + i);
+
+            x = _mm_add_ps(x, _mm_mul_ps(v, vDt));
+            __m128 bdt = _mm_mul_ps(b, vDt);
+            a = _mm_add_ps(_mm_add_ps(a, _mm_add_ps(bdt, bdt)), _mm_add_ps(_mm_mul_ps(_mm_mul_ps(d, vDt), vDt), vQ00));
+            b = _mm_add_ps(_mm_add_ps(b, _mm_mul_ps(d, vDt)), vQ01);
+            d = _mm_add_ps(d, vQ11);
+
+            // gains scaled by w / (w * a + r) == 1 / (a + r / w), and 0 where w is 0
+            __m128 s = _mm_div_ps(w, _mm_add_ps(_mm_mul_ps(w, a), vR));
+            __m128 k0 = _mm_mul_ps(a, s), k1 = _mm_mul_ps(b, s);
+            __m128 innovation = _mm_sub_ps(_mm_load_ps(measurement + i), x);
+            x = _mm_add_ps(x, _mm_mul_ps(k0, innovation));
+            v = _mm_add_ps(v, _mm_mul_ps(k1, innovation));
+            d = _mm_sub_ps(d, _mm_mul_ps(k1, b));
+            b = _mm_sub_ps(b, _mm_mul_ps(k0, b));
+            a = _mm_sub_ps(a, _mm_mul_ps(k0, a));
+
+            _mm_store_ps(position + i, x);
+            _mm_store_ps(velocity + i, v);
+            _mm_store_ps(p00 + i, _mm_max_ps(a, zero));
+            _mm_store_ps(p01 + i, b);
+            _mm_store_ps(p11 + i, _mm_max_ps(d, zero));
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            float x = position[i] + velocity[i] * dt, v = velocity[i];
+            float a = p00[i] + 2 * p01[i] * dt + p11[i] * dt * dt + q00;
+            float b = p01[i] + p11[i] * dt + q01;
+            float d = p11[i] + q11;
+
+            const float s = weight[i] / (weight[i] * a + r);
+            const float k0 = a * s, k1 = b * s;
+            const float innovation = measurement[i] - x;
+            x += k0 * innovation;
+            v += k1 * innovation;
+            d -= k1 * b;
+            b -= k0 * b;
+            a -= k0 * a;
+
+            position[i] = x;
+            velocity[i] = v;
+            p00[i] = max(a, 0.0f);
+            p01[i] = b;
+            p11[i] = max(d, 0.0f);
+        }
+    }
+
+    void BodySmoother::setup(const Options& options)
+    {
+        this->options = options;
+        stride = (options.maxBodies + 3) & ~size_t(3);
+        slots.setup(options.maxBodies);
+
+        const size_t count = Body::JOINT_COUNT * stride;
+        const size_t arrayCount = CHANNEL_COUNT * 6 + 1; // measurements, states, weights
+        storage.assign(count * arrayCount + 3, 0.0f);
+        float* p = storage.data();
+        p += ((16 - (uintptr_t)p % 16) % 16) / sizeof(float);
+        for (int c = 0; c < CHANNEL_COUNT; c++)
+        {
+            measurements[c] = p, p += count;
+            for (int s = 0; s < 5; s++)
+                states[c][s] = p, p += count;
+        }
+        weights = p;
+        lastSeconds = -1;
+    }
+
+    void BodySmoother::attach(Device* device)
+    {
+        if (stride == 0)
+            setup();
+        connection = device->signalBodyDirty.connect(1, [this, device] {
+            double seconds = device->bodyTimestamp ? device->bodyTimestamp * 1e-6 : app::getElapsedSeconds();
+            process(&device->bodies, seconds);
+        });
+    }
+
+    void BodySmoother::detach() { connection.disconnect(); }
+
+    void BodySmoother::reset()
+    {
+        slots.reset();
+        lastSeconds = -1;
+    }
+
+    void BodySmoother::process(vector<Body>* bodies, double seconds)
+    {
+        if (stride == 0)
+            setup();
+
+        float dt = lastSeconds < 0 ? 0 : (float)(seconds - lastSeconds);
+        if (dt <= 0 || dt > 1.0f)
+            dt = 1.0f / 30; // first frame, clock reset or a long gap
+        lastSeconds = seconds;
+
+        slots.match(*bodies);
+
+        // Lanes of missing ids get weight 0 and stay untouched, new ids start at their measurement
+        const size_t count = Body::JOINT_COUNT * stride;
+        fill(weights, weights + count, 0.0f);
+        for (size_t b = 0; b < bodies->size(); b++)
+        {
+            const int s = slots.getSlot(b);
+            if (s < 0)
+                continue;
+            const bool isNew = slots.isNew(b);
+
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                const auto& joint = (*bodies)[b].joints[j];
+                const size_t i = j * stride + s;
+                const float values[CHANNEL_COUNT] = {joint.pos3d.x, joint.pos3d.y, joint.pos3d.z, joint.pos2d.x,
+                                                     joint.pos2d.y};
+                const float scale = options.imageScale;
+                const float measurementNoise[CHANNEL_COUNT] = {
+                    options.measurementNoise, options.measurementNoise, options.measurementNoise,
+                    options.measurementNoise * scale, options.measurementNoise * scale};
+                weights[i] = options.confidenceWeights[joint.confidence];
+                for (int c = 0; c < CHANNEL_COUNT; c++)
+                {
+                    measurements[c][i] = values[c];
+                    if (isNew)
+                    {
+                        states[c][0][i] = values[c];
+                        states[c][1][i] = 0;
+                        states[c][2][i] = measurementNoise[c] * measurementNoise[c];
+                        states[c][3][i] = 0;
+                        states[c][4][i] = options.processNoise * options.processNoise * (c < U ? 1 : scale * scale);
+                    }
+                }
+            }
+        }
+
+        for (int c = 0; c < CHANNEL_COUNT; c++)
+        {
+            float** state = states[c];
+            const float scale = c < U ? 1.0f : options.imageScale;
+            if (options.filter == ONE_EURO)
+                filterOneEuro(state[0], state[1], measurements[c], weights, count, dt, options.minCutoff,
+                              options.beta / scale, options.derivativeCutoff);
+            else
+                filterKalman(state[0], state[1], state[2], state[3], state[4], measurements[c], weights, count, dt,
+                             options.processNoise * options.processNoise * scale * scale,
+                             options.measurementNoise * options.measurementNoise * scale * scale);
+        }
+
+        for (size_t b = 0; b < bodies->size(); b++)
+        {
+            const int s = slots.getSlot(b);
+            if (s < 0)
+                continue;
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                auto& joint = (*bodies)[b].joints[j];
+                const size_t i = j * stride + s;
+                joint.pos3d = vec3(states[X][0][i], states[Y][0][i], states[Z][0][i]);
+                joint.pos2d = vec2(states[U][0][i], states[V][0][i]);
+            }
+        }
+    }
+} // namespace ds
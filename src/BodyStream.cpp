@@ -0,0 +1,544 @@
+#include "BodyStream.h"
+
+#include "cinder/Log.h"
+#include "cinder/app/App.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static const uint8_t kMagic[2] = {'d', 'b'};
+    static const uint8_t kVersion = 1;
+    static const size_t kHeaderBytes = 22;
+    static const size_t kMaxBodyBytes = 10 + 1 + 8 + Body::JOINT_COUNT * 8 * 5; // every varint at its longest
+    static const float kUvScale = 4096.0f;
+    static const float kQuatRange = 0.70710678f; // the three smallest components are within +-1/sqrt(2)
+    static const float kQuatScale = 4095.0f;
+    static const int32_t kMaxValue = 1 << 29;    // keeps differences within int32
+
+    enum
+    {
+        FRAME_KEY = 1,
+        BODY_DELTA = 1,
+        BODY_CONFIDENCES = 2,
+    };
+
+    static inline uint64_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+    static inline int32_t unzigzag(uint64_t v) { return (int32_t)((uint32_t)(v >> 1) ^ (0u - (uint32_t)(v & 1))); }
+
+    static inline uint8_t* writeVarint(uint8_t* p, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            *p++ = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (uint8_t)v;
+        return p;
+    }
+
+    static inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t* v)
+    {
+        uint64_t result = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7)
+        {
+            const uint8_t byte = *p++;
+            result |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                *v = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static inline uint8_t* writeLittleEndian(uint8_t* p, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            *p++ = (uint8_t)(v >> (8 * i));
+        return p;
+    }
+
+    static inline uint64_t readLittleEndian(const uint8_t* p, int bytes)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++)
+            v |= (uint64_t)p[i] << (8 * i);
+        return v;
+    }
+
+    static inline int32_t roundToInt(float v) { return (int32_t)(v + (v < 0 ? -0.5f : 0.5f)); }
+
+    static inline int32_t quantize(float v, float scale)
+    {
+        const float q = v * scale;
+        if (!(q > -kMaxValue))
+            return -kMaxValue;
+        return q < kMaxValue ? roundToInt(q) : kMaxValue;
+    }
+
+    static void quantize(const Body& body, float positionStep, BodyEncoder::State* state)
+    {
+        typedef BodyEncoder::State State;
+        state->id = body.id;
+        state->confidences = 0;
+        const float positionScale = 1.0f / positionStep;
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            const auto& joint = body.joints[j];
+            int32_t* values = state->values[j];
+            values[State::X] = quantize(joint.pos3d.x, positionScale);
+            values[State::Y] = quantize(joint.pos3d.y, positionScale);
+            values[State::Z] = quantize(joint.pos3d.z, positionScale);
+            values[State::U] = quantize(joint.pos2d.x, kUvScale);
+            values[State::V] = quantize(joint.pos2d.y, kUvScale);
+            state->confidences |= (uint64_t)(joint.confidence & 3) << (2 * j);
+
+            // Smallest three: drop the largest component, made positive, the others follow in w, x, y, z order
+            float q[4] = {joint.orientation.w, joint.orientation.x, joint.orientation.y, joint.orientation.z};
+            int largest = 0;
+            for (int c = 1; c < 4; c++)
+                if (abs(q[c]) > abs(q[largest]))
+                    largest = c;
+            const float sign = q[largest] < 0 ? -1.0f : 1.0f;
+            values[State::LARGEST] = largest;
+            for (int c = 0, k = State::A; c < 4; c++)
+            {
+                if (c == largest)
+                    continue;
+                const float v = clamp(q[c] * sign, -kQuatRange, kQuatRange);
+                values[k++] = roundToInt((v + kQuatRange) * (kQuatScale / (2 * kQuatRange)));
+            }
+        }
+    }
+
+    static void dequantize(const BodyEncoder::State& state, float positionStep, Body* body)
+    {
+        typedef BodyEncoder::State State;
+        body->id = state.id;
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            auto& joint = body->joints[j];
+            const int32_t* values = state.values[j];
+            joint.pos3d = vec3(values[State::X], values[State::Y], values[State::Z]) * positionStep;
+            joint.pos2d = vec2(values[State::U], values[State::V]) / kUvScale;
+            joint.confidence = (Body::JointConfidence)((state.confidences >> (2 * j)) & 3);
+
+            float q[4];
+            float sum = 0;
+            const int largest = values[State::LARGEST] & 3;
+            for (int c = 0, k = State::A; c < 4; c++)
+            {
+                if (c == largest)
+                    continue;
+                q[c] = values[k++] / kQuatScale * (2 * kQuatRange) - kQuatRange;
+                sum += q[c] * q[c];
+            }
+            q[largest] = sqrt(max(0.0f, 1 - sum));
+            joint.orientation = quat(q[0], q[1], q[2], q[3]);
+        }
+    }
+
+    static const BodyEncoder::State* findState(const BodyEncoder::State* states, size_t count, uint64_t id)
+    {
+        for (size_t i = 0; i < count; i++)
+            if (states[i].id == id)
+                return &states[i];
+        return nullptr;
+    }
+
+    void BodyEncoder::setup(const Options& options)
+    {
+        this->options = options;
+        if (!(this->options.positionStep > 0))
+            this->options.positionStep = 0.001f;
+        reset();
+    }
+
+    void BodyEncoder::reset()
+    {
+        framesToKeyframe = 0;
+        stateCounts[0] = stateCounts[1] = 0;
+    }
+
+    size_t BodyEncoder::encode(const vector<Body>& bodies, uint64_t timestamp, uint8_t* buffer, size_t capacity)
+    {
+        if (capacity < kHeaderBytes)
+            return 0;
+        const bool isKey = framesToKeyframe <= 0;
+        if (isKey)
+            framesToKeyframe = max(options.keyframeInterval, 1);
+        framesToKeyframe--;
+
+        uint32_t positionStepBits;
+        memcpy(&positionStepBits, &options.positionStep, sizeof(float));
+        uint8_t* p = buffer;
+        *p++ = kMagic[0];
+        *p++ = kMagic[1];
+        *p++ = kVersion;
+        *p++ = isKey ? FRAME_KEY : 0;
+        p = writeLittleEndian(p, sequence, 4);
+        p = writeLittleEndian(p, timestamp, 8);
+        p = writeLittleEndian(p, positionStepBits, 4);
+        uint8_t* bodyCount = p++;
+        *p++ = Body::JOINT_COUNT;
+
+        const int current = 1 - previous;
+        const size_t count = min(bodies.size(), (size_t)kMaxBodies);
+        size_t written = 0;
+        for (size_t b = 0; b < count && capacity - (p - buffer) >= kMaxBodyBytes; b++)
+        {
+            State& state = states[current][written++];
+            quantize(bodies[b], options.positionStep, &state);
+            const State* last = isKey ? nullptr : findState(states[previous], stateCounts[previous], state.id);
+
+            p = writeVarint(p, state.id);
+            const bool hasConfidences = !last || last->confidences != state.confidences;
+            *p++ = (last ? BODY_DELTA : 0) | (hasConfidences ? BODY_CONFIDENCES : 0);
+            if (hasConfidences)
+                p = writeLittleEndian(p, state.confidences, 8);
+
+            static const int32_t zeros[State::VALUE_COUNT] = {};
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                const int32_t* v = state.values[j];
+                const int32_t* base = last ? last->values[j] : zeros;
+                p = writeVarint(p, zigzag(v[State::X] - base[State::X]));
+                p = writeVarint(p, zigzag(v[State::Y] - base[State::Y]));
+                p = writeVarint(p, zigzag(v[State::Z] - base[State::Z]));
+                p = writeVarint(p, zigzag(v[State::U] - base[State::U]));
+                p = writeVarint(p, zigzag(v[State::V] - base[State::V]));
+                p = writeVarint(p, zigzag(v[State::A] - base[State::A]) << 2 |
+                                       ((v[State::LARGEST] - base[State::LARGEST]) & 3));
+                p = writeVarint(p, zigzag(v[State::B] - base[State::B]));
+                p = writeVarint(p, zigzag(v[State::C] - base[State::C]));
+            }
+        }
+        *bodyCount = (uint8_t)written;
+
+        stateCounts[current] = written;
+        previous = current;
+        sequence++;
+        return p - buffer;
+    }
+
+    void BodyDecoder::reset()
+    {
+        hasFrame = false;
+        stateCounts[0] = stateCounts[1] = 0;
+    }
+
+    bool BodyDecoder::decode(const uint8_t* data, size_t size, vector<Body>* bodies, uint64_t* timestamp)
+    {
+        typedef BodyEncoder::State State;
+        if (size < kHeaderBytes || data[0] != kMagic[0] || data[1] != kMagic[1] || data[2] != kVersion ||
+            data[21] != Body::JOINT_COUNT)
+            return false;
+        const bool isKey = (data[3] & FRAME_KEY) != 0;
+        const uint32_t frameSequence = (uint32_t)readLittleEndian(data + 4, 4);
+        const uint64_t frameTimestamp = readLittleEndian(data + 8, 8);
+        const uint32_t positionStepBits = (uint32_t)readLittleEndian(data + 16, 4);
+        float positionStep;
+        memcpy(&positionStep, &positionStepBits, sizeof(float));
+        const size_t count = data[20];
+        if (count > BodyEncoder::kMaxBodies)
+            return false;
+        if (!isKey && (!hasFrame || frameSequence != sequence + 1))
+        {
+            hasFrame = false; // a frame was lost, the next keyframe restarts
+            return false;
+        }
+
+        const int current = 1 - previous;
+        const uint8_t* p = data + kHeaderBytes;
+        const uint8_t* end = data + size;
+        bodies->resize(count);
+        for (size_t b = 0; b < count; b++)
+        {
+            State& state = states[current][b];
+            uint64_t v;
+            if (!readVarint(p, end, &state.id) || p >= end)
+                return hasFrame = false;
+            const uint8_t flags = *p++;
+            const State* last = nullptr;
+            if (flags & BODY_DELTA)
+            {
+                last = findState(states[previous], stateCounts[previous], state.id);
+                if (!last)
+                    return hasFrame = false;
+            }
+            if (flags & BODY_CONFIDENCES)
+            {
+                if (end - p < 8)
+                    return hasFrame = false;
+                state.confidences = readLittleEndian(p, 8);
+                p += 8;
+            }
+            else
+                state.confidences = last ? last->confidences : 0;
+
+            static const int32_t zeros[State::VALUE_COUNT] = {};
+            static const int order[] = {State::X, State::Y, State::Z, State::U, State::V, State::A, State::B, State::C};
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                int32_t* values = state.values[j];
+                const int32_t* base = last ? last->values[j] : zeros;
+                for (int k : order)
+                {
+                    if (!readVarint(p, end, &v))
+                        return hasFrame = false;
+                    if (k == State::A)
+                    {
+                        values[State::LARGEST] = (base[State::LARGEST] + (int32_t)(v & 3)) & 3;
+                        v >>= 2;
+                    }
+                    values[k] = (int32_t)((uint32_t)base[k] + (uint32_t)unzigzag(v));
+                }
+            }
+            dequantize(state, positionStep, &(*bodies)[b]);
+        }
+
+        stateCounts[current] = count;
+        previous = current;
+        sequence = frameSequence;
+        hasFrame = true;
+        *timestamp = frameTimestamp;
+        return true;
+    }
+
+#if defined(_WIN32)
+    typedef int socklen_t;
+    typedef SOCKET NativeSocket;
+    static const intptr_t kNoSocket = (intptr_t)INVALID_SOCKET;
+
+    static bool initSockets()
+    {
+        static bool isInitialized = false;
+        WSADATA data;
+        if (!isInitialized)
+            isInitialized = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        return isInitialized;
+    }
+
+    static void closeSocket(intptr_t s) { closesocket((NativeSocket)s); }
+
+    static bool setNonBlocking(intptr_t s)
+    {
+        u_long isNonBlocking = 1;
+        return ioctlsocket((NativeSocket)s, FIONBIO, &isNonBlocking) == 0;
+    }
+#else
+    typedef int NativeSocket;
+    static const intptr_t kNoSocket = -1;
+
+    static bool initSockets() { return true; }
+
+    static void closeSocket(intptr_t s) { ::close((NativeSocket)s); }
+
+    static bool setNonBlocking(intptr_t s)
+    {
+        const int flags = fcntl((NativeSocket)s, F_GETFL);
+        return flags >= 0 && fcntl((NativeSocket)s, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+#endif
+
+    // "udp://host:port" or "unix:///path", returns the socket and fills address, or kNoSocket
+    static intptr_t openSocket(const string& url, sockaddr_storage* address, socklen_t* addressLength, string* unixPath)
+    {
+        if (!initSockets())
+            return kNoSocket;
+        memset(address, 0, sizeof(*address));
+        int family = 0;
+        if (url.compare(0, 6, "udp://") == 0)
+        {
+            const size_t colon = url.rfind(':');
+            if (colon <= 6)
+            {
+                CI_LOG_E("No port in " << url);
+                return kNoSocket;
+            }
+            const string host = url.substr(6, colon - 6), port = url.substr(colon + 1);
+            addrinfo hints = {}, *result = nullptr;
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_DGRAM;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr)
+            {
+                CI_LOG_E("Can not resolve " << url);
+                return kNoSocket;
+            }
+            memcpy(address, result->ai_addr, result->ai_addrlen);
+            *addressLength = (socklen_t)result->ai_addrlen;
+            freeaddrinfo(result);
+            family = AF_INET;
+        }
+#if !defined(_WIN32)
+        else if (url.compare(0, 7, "unix://") == 0)
+        {
+            sockaddr_un* local = (sockaddr_un*)address;
+            *unixPath = url.substr(7);
+            if (unixPath->empty() || unixPath->size() >= sizeof(local->sun_path))
+            {
+                CI_LOG_E("Bad socket path in " << url);
+                return kNoSocket;
+            }
+            local->sun_family = AF_UNIX;
+            memcpy(local->sun_path, unixPath->c_str(), unixPath->size() + 1);
+            *addressLength = (socklen_t)sizeof(sockaddr_un);
+            family = AF_UNIX;
+        }
+#endif
+        else
+        {
+            CI_LOG_E("Unsupported address " << url);
+            return kNoSocket;
+        }
+
+        const intptr_t s = (intptr_t)::socket(family, SOCK_DGRAM, 0);
+        if (s == kNoSocket)
+        {
+            CI_LOG_E("Can not open a socket for " << url);
+            return kNoSocket;
+        }
+        // Sending never waits on a slow receiver, receiving polls
+        if (!setNonBlocking(s))
+            CI_LOG_W("Socket for " << url << " is blocking");
+        return s;
+    }
+
+    bool BodyPublisher::setup(const string& address, const BodyEncoder::Options& options)
+    {
+        close();
+        static_assert(sizeof(this->address) >= sizeof(sockaddr_storage), "address storage");
+        socklen_t length = 0;
+        string unixPath;
+        socket = openSocket(address, (sockaddr_storage*)this->address, &length, &unixPath);
+        if (socket == kNoSocket)
+            return false;
+        addressLength = (int)length;
+        encoder.setup(options);
+        buffer.resize(BodyEncoder::kMaxBytes);
+        return true;
+    }
+
+    void BodyPublisher::close()
+    {
+        connection.disconnect();
+        if (socket != kNoSocket)
+            closeSocket(socket);
+        socket = kNoSocket;
+    }
+
+    void BodyPublisher::attach(Device* device)
+    {
+        connection = device->signalBodyDirty.connect([this, device] {
+            uint64_t timestamp = device->bodyTimestamp;
+            if (timestamp == 0)
+                timestamp = (uint64_t)(app::getElapsedSeconds() * 1e6);
+            publish(device->bodies, timestamp);
+        });
+    }
+
+    void BodyPublisher::detach() { connection.disconnect(); }
+
+    bool BodyPublisher::publish(const vector<Body>& bodies, uint64_t timestamp)
+    {
+        if (socket == kNoSocket)
+            return false;
+
+        const auto start = chrono::steady_clock::now();
+        const size_t size = encoder.encode(bodies, timestamp, buffer.data(), buffer.size());
+        stats.encodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats.frames++;
+        stats.bodies += min(bodies.size(), (size_t)BodyEncoder::kMaxBodies);
+        stats.bytes += size;
+
+        if (size == 0 || sendto((NativeSocket)socket, (const char*)buffer.data(), (int)size, 0,
+                                (const sockaddr*)address, (socklen_t)addressLength) != (int)size)
+        {
+            stats.dropped++;
+            return false;
+        }
+        return true;
+    }
+
+    bool BodyReceiver::setup(const string& address)
+    {
+        close();
+        sockaddr_storage local;
+        socklen_t length = 0;
+        string path;
+        socket = openSocket(address, &local, &length, &path);
+        if (socket == kNoSocket)
+            return false;
+#if !defined(_WIN32)
+        if (!path.empty())
+            unlink(path.c_str()); // left over by a receiver that did not close
+#endif
+        if (::bind((NativeSocket)socket, (const sockaddr*)&local, length) != 0)
+        {
+            CI_LOG_E("Can not bind " << address);
+            close();
+            return false;
+        }
+        unixPath = path;
+        buffer.resize(BodyEncoder::kMaxBytes);
+        decoded.reserve(BodyEncoder::kMaxBodies);
+        decoder.reset();
+        return true;
+    }
+
+    void BodyReceiver::close()
+    {
+        if (socket != kNoSocket)
+            closeSocket(socket);
+        socket = kNoSocket;
+#if !defined(_WIN32)
+        if (!unixPath.empty())
+            unlink(unixPath.c_str());
+#endif
+        unixPath.clear();
+    }
+
+    bool BodyReceiver::receive(vector<Body>* bodies, uint64_t* timestamp)
+    {
+        bool isReceived = false;
+        while (socket != kNoSocket)
+        {
+            const int size = (int)recv((NativeSocket)socket, (char*)buffer.data(), (int)buffer.size(), 0);
+            if (size <= 0)
+                break;
+            // Every frame is decoded to keep up with the deltas, only the newest is returned
+            if (decoder.decode(buffer.data(), size, &decoded, timestamp))
+            {
+                bodies->assign(decoded.begin(), decoded.end());
+                isReceived = true;
+            }
+        }
+        return isReceived;
+    }
+} // namespace ds
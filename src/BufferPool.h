@@ -0,0 +1,42 @@
+#pragma once
+
+#include "cinder/Channel.h"
+
+#include <memory>
+#include <vector>
+
+namespace ds
+{
+    // Recycles frame storage between updates. A buffer goes back into circulation once the pool holds the only
+    // reference to it, i.e. every channel published from it has been dropped or overwritten by the app.
+    // Not thread-safe, meant to be owned by the thread that publishes the frames.
+    template <typename T> struct BufferPool
+    {
+        std::shared_ptr<T> acquire(size_t count)
+        {
+            if (count != bufferSize)
+            {
+                buffers.clear();
+                bufferSize = count;
+            }
+
+            for (auto& buffer : buffers)
+            {
+                if (buffer.use_count() == 1)
+                    return buffer;
+            }
+
+            buffers.emplace_back(new T[count], std::default_delete<T[]>());
+            return buffers.back();
+        }
+
+        ci::ChannelT<T> acquireChannel(int32_t width, int32_t height)
+        {
+            auto buffer = acquire(width * height);
+            return ci::ChannelT<T>(width, height, sizeof(T) * width, 1, buffer.get(), buffer);
+        }
+
+        std::vector<std::shared_ptr<T>> buffers;
+        size_t bufferSize = 0;
+    };
+} // namespace ds
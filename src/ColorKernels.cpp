@@ -0,0 +1,287 @@
+#include "ColorKernels.h"
+#include "Simd.h"
+
+namespace ds
+{
+    // All paths compute ((a << 6) * (k << 2)) >> 16 like _mm_mulhi_epi16, so SIMD and scalar agree bit for bit
+    static inline int mulhi(int a, int k) { return (a * 64 * k * 4) >> 16; }
+
+    static inline uint8_t clamp8(int v) { return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v; }
+
+    static inline void yuvToBGRA(uint8_t* dst, int y, int u, int v)
+    {
+        y = mulhi(y - 16, 298);
+        u -= 128;
+        v -= 128;
+        dst[0] = clamp8(y + mulhi(u, 516));
+        dst[1] = clamp8(y - mulhi(u, 100) - mulhi(v, 208));
+        dst[2] = clamp8(y + mulhi(v, 409));
+        dst[3] = 255;
+    }
+
+#ifdef DS_USE_SSE2
+    // 8 pixels of 16 bit y, u, v to BGRA
+    static inline void yuvToBGRA(uint8_t* dst, __m128i y, __m128i u, __m128i v)
+    {
+        const __m128i c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128);
+        y = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y, c16), 6), _mm_set1_epi16(298 * 4));
+        u = _mm_slli_epi16(_mm_sub_epi16(u, c128), 6);
+        v = _mm_slli_epi16(_mm_sub_epi16(v, c128), 6);
+
+        __m128i b = _mm_add_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(516 * 4)));
+        __m128i g = _mm_sub_epi16(_mm_sub_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(100 * 4))),
+                                  _mm_mulhi_epi16(v, _mm_set1_epi16(208 * 4)));
+        __m128i r = _mm_add_epi16(y, _mm_mulhi_epi16(v, _mm_set1_epi16(409 * 4)));
+
+        __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+        __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(-1));
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    // uv: U0 V0 U1 V1 U2 V2 U3 V3, each pair shared by two pixels
+    static inline void yuvToBGRA(uint8_t* dst, __m128i y, __m128i uv)
+    {
+        __m128i u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        __m128i v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        yuvToBGRA(dst, y, u, v);
+    }
+#endif
+
+    void convertYUY2ToBGRA(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                           int height, int scale)
+    {
+        const int dstWidth = width / scale, dstHeight = height / scale;
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < dstHeight; y++)
+        {
+            uint8_t* out = dst + y * dstRowBytes;
+            const uint8_t* row = src + (size_t)y * scale * srcRowBytes;
+            int x = 0;
+
+            if (scale == 1)
+            {
+#ifdef DS_USE_SSE2
+                const __m128i lowBytes = _mm_set1_epi16(0xFF);
+                for (; x + 8 <= width; x += 8)
+                {
+                    __m128i yuyv = _mm_loadu_si128((const __m128i*)(row + x * 2));
+                    yuvToBGRA(out + x * 4, _mm_and_si128(yuyv, lowBytes), _mm_srli_epi16(yuyv, 8));
+                }
+#endif
+                for (; x < width; x += 2)
+                {
+                    const uint8_t* p = row + x * 2;
+                    yuvToBGRA(out + x * 4, p[0], p[1], p[3]);
+                    yuvToBGRA(out + x * 4 + 4, p[2], p[1], p[3]);
+                }
+                continue;
+            }
+
+            const uint8_t* next = row + srcRowBytes;
+#ifdef DS_USE_SSE2
+            if (scale == 2)
+            {
+                // one macropixel per output pixel: y = Y0 + Y1, u, v summed over both rows in 32 bit lanes
+                const __m128i lowByte = _mm_set1_epi32(0xFF);
+                for (; x + 8 <= dstWidth; x += 8)
+                {
+                    __m128i y2[2], u2[2], v2[2];
+                    for (int half = 0; half < 2; half++)
+                    {
+                        __m128i a = _mm_loadu_si128((const __m128i*)(row + x * 4 + half * 16));
+                        __m128i b = _mm_loadu_si128((const __m128i*)(next + x * 4 + half * 16));
+                        __m128i y = _mm_add_epi32(_mm_and_si128(a, lowByte), _mm_and_si128(_mm_srli_epi32(a, 16), lowByte));
+                        y = _mm_add_epi32(y, _mm_add_epi32(_mm_and_si128(b, lowByte),
+                                                           _mm_and_si128(_mm_srli_epi32(b, 16), lowByte)));
+                        y2[half] = y;
+                        u2[half] = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), lowByte),
+                                                 _mm_and_si128(_mm_srli_epi32(b, 8), lowByte));
+                        v2[half] = _mm_add_epi32(_mm_srli_epi32(a, 24), _mm_srli_epi32(b, 24));
+                    }
+                    __m128i y = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(y2[0], y2[1]), _mm_set1_epi16(2)), 2);
+                    __m128i u = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(u2[0], u2[1]), _mm_set1_epi16(1)), 1);
+                    __m128i v = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(v2[0], v2[1]), _mm_set1_epi16(1)), 1);
+                    yuvToBGRA(out + x * 4, y, u, v);
+                }
+            }
+#endif
+            for (; x < dstWidth; x++)
+            {
+                // the block is one macropixel wide
+                const uint8_t *p = row + x * scale * 2, *q = next + x * scale * 2;
+                yuvToBGRA(out + x * 4, (p[0] + p[2] + q[0] + q[2] + 2) >> 2, (p[1] + q[1] + 1) >> 1,
+                          (p[3] + q[3] + 1) >> 1);
+            }
+        }
+    }
+
+    void convertNV12ToBGRA(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                           int height, int scale)
+    {
+        const int dstWidth = width / scale, dstHeight = height / scale;
+        const uint8_t* chroma = src + (size_t)height * srcRowBytes;
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < dstHeight; y++)
+        {
+            uint8_t* out = dst + y * dstRowBytes;
+            const uint8_t* row = src + (size_t)y * scale * srcRowBytes;
+            const uint8_t* uvRow = chroma + (size_t)(y * scale / 2) * srcRowBytes;
+            int x = 0;
+
+            if (scale == 1)
+            {
+#ifdef DS_USE_SSE2
+                const __m128i zero = _mm_setzero_si128();
+                for (; x + 8 <= width; x += 8)
+                {
+                    __m128i luma = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + x)), zero);
+                    __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(uvRow + x)), zero);
+                    yuvToBGRA(out + x * 4, luma, uv);
+                }
+#endif
+                for (; x < width; x += 2)
+                {
+                    const uint8_t* uv = uvRow + x;
+                    yuvToBGRA(out + x * 4, row[x], uv[0], uv[1]);
+                    yuvToBGRA(out + x * 4 + 4, row[x + 1], uv[0], uv[1]);
+                }
+                continue;
+            }
+
+            const uint8_t* next = row + srcRowBytes;
+#ifdef DS_USE_SSE2
+            if (scale == 2)
+            {
+                // 16 lumas per row add up pairwise, and every output pixel gets its own chroma pair
+                const __m128i lowByte = _mm_set1_epi16(0xFF);
+                for (; x + 8 <= dstWidth; x += 8)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(row + x * 2));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(next + x * 2));
+                    __m128i y = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lowByte), _mm_srli_epi16(a, 8)),
+                                              _mm_add_epi16(_mm_and_si128(b, lowByte), _mm_srli_epi16(b, 8)));
+                    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(2)), 2);
+                    __m128i uv = _mm_loadu_si128((const __m128i*)(uvRow + x * 2));
+                    yuvToBGRA(out + x * 4, y, _mm_and_si128(uv, lowByte), _mm_srli_epi16(uv, 8));
+                }
+            }
+#endif
+            for (; x < dstWidth; x++)
+            {
+                // one chroma sample covers the block
+                const int sx = x * scale;
+                const uint8_t* uv = uvRow + sx;
+                yuvToBGRA(out + x * 4, (row[sx] + row[sx + 1] + next[sx] + next[sx + 1] + 2) >> 2, uv[0], uv[1]);
+            }
+        }
+    }
+
+    void downscale4(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width, int height,
+                    int scale)
+    {
+        const int dstWidth = width / scale, dstHeight = height / scale;
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < dstHeight; y++)
+        {
+            uint8_t* out = dst + y * dstRowBytes;
+            const uint8_t* row = src + (size_t)y * scale * srcRowBytes;
+            const uint8_t* next = row + srcRowBytes;
+            int x = 0;
+
+#ifdef DS_USE_SSE2
+            if (scale == 2)
+            {
+                // two output pixels per iteration: average rows, then the horizontal pairs
+                const __m128i zero = _mm_setzero_si128();
+                for (; x + 2 <= dstWidth; x += 2)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(row + x * 8));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(next + x * 8));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                    sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+                    _mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+                }
+            }
+#endif
+            for (; x < dstWidth; x++)
+            {
+                const uint8_t *p = row + x * scale * 4, *q = next + x * scale * 4;
+                for (int c = 0; c < 4; c++)
+                    out[x * 4 + c] = (uint8_t)((p[c] + p[c + 4] + q[c] + q[c + 4] + 2) >> 2);
+            }
+        }
+    }
+
+    void convertToLuma16(uint16_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                         int height, int pixelInc, const int channelOffsets[3], const float weights[3], float gain)
+    {
+        // coefficient per byte of a pixel, 0 for the unused ones
+        int k[4] = {};
+        for (int c = 0; c < 3; c++)
+            k[channelOffsets[c]] = (int)(weights[c] * gain * 256 + 0.5f);
+
+#ifdef DS_USE_SSE2
+        const bool useSimd = k[0] < 0x8000 && k[1] < 0x8000 && k[2] < 0x8000 && k[3] < 0x8000;
+#endif
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t* in = src + y * srcRowBytes;
+            uint16_t* out = (uint16_t*)((uint8_t*)dst + y * dstRowBytes);
+            int x = 0;
+
+#ifdef DS_USE_SSE2
+            if (useSimd)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i coeffs = _mm_setr_epi16(k[0], k[1], k[2], k[3], k[0], k[1], k[2], k[3]);
+                const __m128i round = _mm_set1_epi32(128);
+                const __m128i bias32 = _mm_set1_epi32(0x8000);
+                const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+                // two loads of 4 pixels, each reading 16 bytes of which 12 or 16 are used
+                for (; (x + 4) * pixelInc + 16 <= width * pixelInc; x += 8)
+                {
+                    __m128i sums[2];
+                    for (int half = 0; half < 2; half++)
+                    {
+                        const uint8_t* p = in + (x + half * 4) * pixelInc;
+                        __m128i v = _mm_loadu_si128((const __m128i*)p);
+                        if (pixelInc == 3)
+                        {
+                            // spread to 4 bytes per pixel, the extra byte has a 0 coefficient
+                            __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+                            __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+                            v = _mm_unpacklo_epi64(p01, p23);
+                        }
+                        // (c0 k0 + c1 k1, c2 k2 + c3 k3) per pixel, then add the halves
+                        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), coeffs);
+                        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), coeffs);
+                        __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0));
+                        __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1));
+                        __m128i sum = _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+                        sums[half] = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(sum, round), 8), bias32);
+                    }
+                    // biased signed pack saturates to [0, 65535] after the flip, as in convertToU16
+                    __m128i packed = _mm_packs_epi32(sums[0], sums[1]);
+                    _mm_storeu_si128((__m128i*)(out + x), _mm_xor_si128(packed, bias16));
+                }
+            }
+#endif
+
+            for (; x < width; x++)
+            {
+                const uint8_t* p = in + x * pixelInc;
+                int sum = (p[0] * k[0] + p[1] * k[1] + p[2] * k[2] + (pixelInc == 4 ? p[3] * k[3] : 0) + 128) >> 8;
+                out[x] = (uint16_t)(sum > 0xFFFF ? 0xFFFF : sum);
+            }
+        }
+    }
+} // namespace ds
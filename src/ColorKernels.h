@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ds
+{
+    // Camera YUV formats to BGRA with alpha 255 (BT.601, limited range). width is even, dst is
+    // (width / scale) x (height / scale). With a scale above 1 each output pixel averages the 2x2 block at the
+    // top left of its scale x scale cell, so the cost follows the output size rather than the capture size.
+
+    // Y0 U Y1 V macropixels
+    void convertYUY2ToBGRA(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                           int height, int scale = 1);
+
+    // Y plane followed by the interleaved half-resolution UV plane, both srcRowBytes apart
+    void convertNV12ToBGRA(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                           int height, int scale = 1);
+
+    // Any 4 byte per pixel image, sampled the same way as above (scale > 1)
+    void downscale4(uint8_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width, int height,
+                    int scale);
+
+    // dst = (r * weights[0] + g * weights[1] + b * weights[2]) * gain, rounded and saturated to 16 bit. src has
+    // pixelInc (3 or 4) bytes per pixel with r, g, b at channelOffsets. Weights times gain are applied in 8 bit
+    // fixed point, the SIMD path takes them up to 127.
+    void convertToLuma16(uint16_t* dst, size_t dstRowBytes, const uint8_t* src, size_t srcRowBytes, int width,
+                         int height, int pixelInc, const int channelOffsets[3], const float weights[3], float gain);
+} // namespace ds
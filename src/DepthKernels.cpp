@@ -0,0 +1,358 @@
+#include "DepthKernels.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace ds
+{
+    void convertToU16(uint16_t* dst, const float* src, size_t count, float scale)
+    {
+        size_t i = 0;
+
+#ifdef __AVX2__
+        {
+            const __m256 s = _mm256_set1_ps(scale);
+            const __m256 lo = _mm256_setzero_ps(), hi = _mm256_set1_ps(65535.0f);
+            for (; i + 16 <= count; i += 16)
+            {
+                // max first: it returns its second operand for NaN
+                __m256 f0 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), s), lo), hi);
+                __m256 f1 = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), s), lo), hi);
+                __m256i packed = _mm256_packus_epi32(_mm256_cvtps_epi32(f0), _mm256_cvtps_epi32(f1));
+                // packus works per 128 bit lane, put the quarters back in order
+                packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256((__m256i*)(dst + i), packed);
+            }
+        }
+#endif
+
+#ifdef DS_USE_SSE2
+        {
+            const __m128 s = _mm_set1_ps(scale);
+            const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(65535.0f);
+            // SSE2 only packs with signed saturation, so pack v - 32768 and flip the sign bit back
+            const __m128i bias32 = _mm_set1_epi32(0x8000);
+            const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128 f0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), s), lo), hi);
+                __m128 f1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), s), lo), hi);
+                __m128i packed = _mm_packs_epi32(_mm_sub_epi32(_mm_cvtps_epi32(f0), bias32),
+                                                 _mm_sub_epi32(_mm_cvtps_epi32(f1), bias32));
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(packed, bias16));
+            }
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            float value = src[i] * scale;
+            value = value > 0.0f ? std::min(value, 65535.0f) : 0.0f;
+            dst[i] = (uint16_t)std::lrint(value);
+        }
+    }
+
+    void DepthRescaler::setup(float scale, uint16_t minDepth, uint16_t maxDepth)
+    {
+        this->scale = scale;
+        this->minDepth = minDepth;
+        this->maxDepth = maxDepth;
+
+        if (scale == 1.0f)
+        {
+            mode = IDENTITY;
+            return;
+        }
+
+        // Scales of 1 and above would need more than 16 bits of headroom, keep them on the float path
+        if (scale > 0.0f && scale < 1.0f)
+        {
+            for (shift = 16; shift <= 32; shift++)
+            {
+                auto exact = std::ldexp((double)scale, shift);
+                double candidates[] = {std::floor(exact), std::ceil(exact)};
+                for (auto candidate : candidates)
+                {
+                    if (candidate < 1 || candidate >= 0x20000)
+                        continue;
+
+                    mode = candidate < 0x10000 ? MULHI : MULHI_ADD;
+                    if (mode == MULHI_ADD && shift < 17)
+                        continue;
+                    multiplier = (uint16_t)((uint32_t)candidate & 0xFFFF);
+
+                    int raw = 0;
+                    while (raw <= 0xFFFF && fixedPoint(raw) == reference(raw))
+                        raw++;
+                    if (raw > 0xFFFF)
+                        return;
+                }
+            }
+        }
+
+        mode = FLOAT;
+    }
+
+    uint16_t DepthRescaler::reference(uint16_t raw) const
+    {
+        float value = raw * scale;
+        return (uint16_t)(int32_t)std::min(value, 65535.0f);
+    }
+
+    uint16_t DepthRescaler::fixedPoint(uint16_t raw) const
+    {
+        switch (mode)
+        {
+        case IDENTITY:
+            return raw;
+        case MULHI:
+            return (uint16_t)(((uint32_t)raw * multiplier) >> shift);
+        case MULHI_ADD:
+            return (uint16_t)(((uint64_t)raw * (0x10000 + multiplier)) >> shift);
+        default:
+            return reference(raw);
+        }
+    }
+
+#ifdef DS_USE_SSE2
+    // Lanes outside of [minDepth, maxDepth] become 0, with unsigned compares built from saturating subtraction
+    static inline __m128i clip(__m128i depth, __m128i minDepth, __m128i maxDepth)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i aboveMin = _mm_cmpeq_epi16(_mm_subs_epu16(minDepth, depth), zero);
+        __m128i belowMax = _mm_cmpeq_epi16(_mm_subs_epu16(depth, maxDepth), zero);
+        return _mm_and_si128(depth, _mm_and_si128(aboveMin, belowMax));
+    }
+
+    // Same as reference() on 4 lanes, returned as 32 bit ints biased by -32768 to suit _mm_packs_epi32
+    static inline __m128i scaleBiased(__m128i raw32, __m128 scale)
+    {
+        __m128 value = _mm_min_ps(_mm_mul_ps(_mm_cvtepi32_ps(raw32), scale), _mm_set1_ps(65535.0f));
+        return _mm_sub_epi32(_mm_cvttps_epi32(value), _mm_set1_epi32(0x8000));
+    }
+#endif
+
+    void DepthRescaler::process(uint16_t* dst, const uint16_t* src, size_t count) const
+    {
+        size_t i = 0;
+
+#ifdef DS_USE_SSE2
+        const __m128i lo = _mm_set1_epi16((short)minDepth);
+        const __m128i hi = _mm_set1_epi16((short)maxDepth);
+
+        if (mode == FLOAT)
+        {
+            const __m128 s = _mm_set1_ps(scale);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i bias = _mm_set1_epi16((short)0x8000);
+
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i raw = _mm_loadu_si128((const __m128i*)(src + i));
+                __m128i depth = _mm_packs_epi32(scaleBiased(_mm_unpacklo_epi16(raw, zero), s),
+                                                scaleBiased(_mm_unpackhi_epi16(raw, zero), s));
+                depth = _mm_xor_si128(depth, bias);
+                _mm_storeu_si128((__m128i*)(dst + i), clip(depth, lo, hi));
+            }
+        }
+        else
+        {
+            const __m128i m = _mm_set1_epi16((short)multiplier);
+            // MULHI_ADD computes ((raw * m >> 16) + raw) >> 1 without overflowing 16 bits, hence the extra bit
+            const __m128i postShift = _mm_cvtsi32_si128(mode == MULHI_ADD ? shift - 17 : shift - 16);
+
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i raw = _mm_loadu_si128((const __m128i*)(src + i));
+                __m128i depth = raw;
+                if (mode == MULHI)
+                {
+                    depth = _mm_srl_epi16(_mm_mulhi_epu16(raw, m), postShift);
+                }
+                else if (mode == MULHI_ADD)
+                {
+                    __m128i t = _mm_mulhi_epu16(raw, m);
+                    t = _mm_add_epi16(t, _mm_srli_epi16(_mm_sub_epi16(raw, t), 1));
+                    depth = _mm_srl_epi16(t, postShift);
+                }
+                _mm_storeu_si128((__m128i*)(dst + i), clip(depth, lo, hi));
+            }
+        }
+#endif
+
+        for (; i < count; i++)
+        {
+            uint16_t depth = fixedPoint(src[i]);
+            dst[i] = (depth >= minDepth && depth <= maxDepth) ? depth : 0;
+        }
+    }
+
+    void DepthToColorMapper::setup(int width, int height, const float* rays, const float rotation[9],
+                                   const float translation[3], float depthScale,
+                                   const PinholeIntrinsics& color)
+    {
+        this->width = width;
+        this->height = height;
+        this->color = color;
+        for (int i = 0; i < 3; i++)
+            this->translation[i] = translation[i];
+
+        size_t count = (size_t)width * height;
+        a.resize(count);
+        b.resize(count);
+        c.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            float rx = rays[i * 2 + 0], ry = rays[i * 2 + 1];
+            a[i] = (rotation[0] * rx + rotation[3] * ry + rotation[6]) * depthScale;
+            b[i] = (rotation[1] * rx + rotation[4] * ry + rotation[7]) * depthScale;
+            c[i] = (rotation[2] * rx + rotation[5] * ry + rotation[8]) * depthScale;
+        }
+    }
+
+#ifdef DS_USE_SSE2
+    static inline __m128 set1(float v) { return _mm_set1_ps(v); }
+
+    // Scalar versions below, 4 lanes here; nx / ny are normalized coordinates, valid lanes may get cleared
+    static inline void distort(const PinholeIntrinsics& color, __m128& nx, __m128& ny, __m128& valid)
+    {
+        const float* k = color.coeffs;
+        const __m128 one = set1(1.0f), two = set1(2.0f);
+        __m128 r2 = _mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny));
+
+        if (color.model == PinholeIntrinsics::MODIFIED_BROWN_CONRADY)
+        {
+            __m128 f = _mm_add_ps(set1(k[1]), _mm_mul_ps(set1(k[4]), r2));
+            f = _mm_add_ps(set1(k[0]), _mm_mul_ps(f, r2));
+            f = _mm_add_ps(one, _mm_mul_ps(f, r2));
+            nx = _mm_mul_ps(nx, f);
+            ny = _mm_mul_ps(ny, f);
+            __m128 xy2 = _mm_mul_ps(two, _mm_mul_ps(nx, ny));
+            __m128 dx = _mm_add_ps(_mm_mul_ps(set1(k[2]), xy2),
+                                   _mm_mul_ps(set1(k[3]), _mm_add_ps(r2, _mm_mul_ps(two, _mm_mul_ps(nx, nx)))));
+            __m128 dy = _mm_add_ps(_mm_mul_ps(set1(k[3]), xy2),
+                                   _mm_mul_ps(set1(k[2]), _mm_add_ps(r2, _mm_mul_ps(two, _mm_mul_ps(ny, ny)))));
+            nx = _mm_add_ps(nx, dx);
+            ny = _mm_add_ps(ny, dy);
+        }
+        else if (color.model == PinholeIntrinsics::RATIONAL_BROWN_CONRADY)
+        {
+            __m128 a = _mm_add_ps(set1(k[1]), _mm_mul_ps(set1(k[2]), r2));
+            a = _mm_add_ps(one, _mm_mul_ps(_mm_add_ps(set1(k[0]), _mm_mul_ps(a, r2)), r2));
+            __m128 b = _mm_add_ps(set1(k[4]), _mm_mul_ps(set1(k[5]), r2));
+            b = _mm_add_ps(one, _mm_mul_ps(_mm_add_ps(set1(k[3]), _mm_mul_ps(b, r2)), r2));
+            __m128 f = _mm_div_ps(a, b);
+            __m128 xy2 = _mm_mul_ps(two, _mm_mul_ps(nx, ny));
+            __m128 dx = _mm_add_ps(_mm_mul_ps(set1(k[6]), xy2),
+                                   _mm_mul_ps(set1(k[7]), _mm_add_ps(r2, _mm_mul_ps(two, _mm_mul_ps(nx, nx)))));
+            __m128 dy = _mm_add_ps(_mm_mul_ps(set1(k[7]), xy2),
+                                   _mm_mul_ps(set1(k[6]), _mm_add_ps(r2, _mm_mul_ps(two, _mm_mul_ps(ny, ny)))));
+            nx = _mm_add_ps(_mm_mul_ps(nx, f), dx);
+            ny = _mm_add_ps(_mm_mul_ps(ny, f), dy);
+        }
+
+        if (color.maxRadius > 0)
+            valid = _mm_and_ps(valid, _mm_cmple_ps(r2, set1(color.maxRadius * color.maxRadius)));
+    }
+#endif
+
+    static inline bool distort(const PinholeIntrinsics& color, float& nx, float& ny)
+    {
+        const float* k = color.coeffs;
+        float r2 = nx * nx + ny * ny;
+
+        if (color.model == PinholeIntrinsics::MODIFIED_BROWN_CONRADY)
+        {
+            float f = 1 + (k[0] + (k[1] + k[4] * r2) * r2) * r2;
+            nx *= f;
+            ny *= f;
+            float xy2 = 2 * nx * ny;
+            float dx = k[2] * xy2 + k[3] * (r2 + 2 * nx * nx);
+            float dy = k[3] * xy2 + k[2] * (r2 + 2 * ny * ny);
+            nx += dx;
+            ny += dy;
+        }
+        else if (color.model == PinholeIntrinsics::RATIONAL_BROWN_CONRADY)
+        {
+            // unlike the modified model, tangential terms use the undistorted coordinates
+            float f = (1 + (k[0] + (k[1] + k[2] * r2) * r2) * r2) / (1 + (k[3] + (k[4] + k[5] * r2) * r2) * r2);
+            float xy2 = 2 * nx * ny;
+            float dx = k[6] * xy2 + k[7] * (r2 + 2 * nx * nx);
+            float dy = k[7] * xy2 + k[6] * (r2 + 2 * ny * ny);
+            nx = nx * f + dx;
+            ny = ny * f + dy;
+        }
+
+        return color.maxRadius <= 0 || r2 <= color.maxRadius * color.maxRadius;
+    }
+
+    void DepthToColorMapper::process(float* texcoords, const uint16_t* depth) const
+    {
+        // texcoord = (pixel + 0.5) / size, pixel = normalized * f + pp
+        const float su = color.fx / color.width, ou = (color.ppx + 0.5f) / color.width;
+        const float sv = color.fy / color.height, ov = (color.ppy + 0.5f) / color.height;
+        const float tx = translation[0], ty = translation[1], tz = translation[2];
+
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++)
+        {
+            int x = 0;
+            size_t row = (size_t)y * width;
+            const uint16_t* src = depth + row;
+            const float *pa = a.data() + row, *pb = b.data() + row, *pc = c.data() + row;
+            float* dst = texcoords + row * 3;
+
+#ifdef DS_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 maskXY0X = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, 0, -1));
+            const __m128 maskY0XY = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, -1));
+            const __m128 mask0XY0 = _mm_castsi128_ps(_mm_setr_epi32(0, -1, -1, 0));
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i d32 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(src + x)), zero);
+                __m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(d32, zero));
+                __m128 d = _mm_cvtepi32_ps(d32);
+
+                __m128 w = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pc + x), d), _mm_set1_ps(tz)));
+                __m128 nx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pa + x), d), _mm_set1_ps(tx)), w);
+                __m128 ny = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pb + x), d), _mm_set1_ps(ty)), w);
+
+                if (color.model != PinholeIntrinsics::NONE || color.maxRadius > 0)
+                    distort(color, nx, ny, valid);
+
+                __m128 u = _mm_and_ps(valid, _mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(su)), _mm_set1_ps(ou)));
+                __m128 v = _mm_and_ps(valid, _mm_add_ps(_mm_mul_ps(ny, _mm_set1_ps(sv)), _mm_set1_ps(ov)));
+
+                // u0 v0 u1 v1 / u2 v2 u3 v3 -> u0 v0 0 u1 / v1 0 u2 v2 / 0 u3 v3 0
+                __m128 lo = _mm_unpacklo_ps(u, v), hi = _mm_unpackhi_ps(u, v);
+                _mm_storeu_ps(dst + x * 3 + 0, _mm_and_ps(maskXY0X, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 0, 1, 0))));
+                _mm_storeu_ps(dst + x * 3 + 4, _mm_and_ps(maskY0XY, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(1, 0, 3, 3))));
+                _mm_storeu_ps(dst + x * 3 + 8, _mm_and_ps(mask0XY0, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 2))));
+            }
+#endif
+
+            for (; x < width; x++)
+            {
+                float* out = dst + x * 3;
+                out[0] = out[1] = out[2] = 0;
+                if (src[x] == 0)
+                    continue;
+
+                float d = src[x];
+                float w = 1.0f / (pc[x] * d + tz);
+                float nx = (pa[x] * d + tx) * w, ny = (pb[x] * d + ty) * w;
+                if (!distort(color, nx, ny))
+                    continue;
+                out[0] = nx * su + ou;
+                out[1] = ny * sv + ov;
+            }
+        }
+    }
+} // namespace ds
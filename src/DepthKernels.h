@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ds
+{
+    // dst = src * scale rounded to nearest and saturated to [0, 65535], NaN becomes 0. Used for the float
+    // depth / IR frames that SDKs like libfreenect2 hand out.
+    void convertToU16(uint16_t* dst, const float* src, size_t count, float scale = 1.0f);
+
+    // Converts raw depth units into a separate buffer as uint16_t(raw * scale), zeroing results outside of
+    // [minDepth, maxDepth]. The per-pixel work is done in 16-bit fixed point; setup() searches for a
+    // multiplier / shift pair that reproduces the float expression for every 16-bit input and keeps the float
+    // loop only for scales that have none.
+    struct DepthRescaler
+    {
+        void setup(float scale, uint16_t minDepth = 0, uint16_t maxDepth = 0xFFFF);
+
+        void process(uint16_t* dst, const uint16_t* src, size_t count) const;
+
+        // The float expression the fixed-point path has to match bit for bit
+        uint16_t reference(uint16_t raw) const;
+
+        bool isFixedPoint() const { return mode != FLOAT; }
+
+        float scale = 1.0f;
+        uint16_t minDepth = 0, maxDepth = 0xFFFF;
+
+      private:
+        enum Mode
+        {
+            IDENTITY,  // raw
+            MULHI,     // (raw * multiplier) >> shift, 16 bit multiplier
+            MULHI_ADD, // (raw * (0x10000 + multiplier)) >> shift, 17 bit multiplier
+            FLOAT,
+        };
+
+        uint16_t fixedPoint(uint16_t raw) const;
+
+        Mode mode = IDENTITY;
+        uint16_t multiplier = 0;
+        int shift = 0;
+    };
+
+    // Pinhole camera plus the forward distortion models of the SDKs that project into color
+    struct PinholeIntrinsics
+    {
+        enum Model
+        {
+            NONE,
+            MODIFIED_BROWN_CONRADY, // librealsense, coeffs: k1 k2 p1 p2 k3
+            RATIONAL_BROWN_CONRADY, // k4a, coeffs: k1 k2 k3 k4 k5 k6 p1 p2
+        };
+
+        int width = 0, height = 0;
+        float ppx = 0, ppy = 0, fx = 0, fy = 0; // texcoord = (pixel + 0.5) / size
+        Model model = NONE;
+        float coeffs[8] = {};
+        float maxRadius = 0; // normalized radius beyond which projection is invalid, 0 for none
+    };
+
+    // Maps every depth pixel to a texcoord of a second (color) camera. A pixel with ray (rx, ry, 1) lands at
+    // R * ray * z + t in the other camera, so with (a, b, c) = R * ray * depthScale its normalized image position
+    // is (a * d + tx, b * d + ty) / (c * d + tz) for a raw depth d. (a, b, c) are precomputed per pixel, which
+    // leaves three multiply-adds, a division and the color intrinsics per pixel and frame.
+    struct DepthToColorMapper
+    {
+        // rays: x, y at z = 1 per depth pixel, rotation: column-major, translation: in m, depthScale: m per unit
+        void setup(int width, int height, const float* rays, const float rotation[9],
+                   const float translation[3], float depthScale, const PinholeIntrinsics& color);
+
+        // Writes x, y = texcoord and z = 0 for every depth pixel (3 floats each), or all 0 where there is no depth
+        void process(float* texcoords, const uint16_t* depth) const;
+
+        int width = 0, height = 0;
+        std::vector<float> a, b, c;
+        float translation[3];
+        PinholeIntrinsics color;
+    };
+} // namespace ds
@@ -5,6 +5,21 @@ using namespace std;
 
 namespace ds
 {
+    const Body::JointType Body::bones[Body::BONE_COUNT][2] = {
+        {HIP_CENTER, SPINE}, {SPINE, SHOULDER_CENTER},
+        {SHOULDER_CENTER, NECK}, {NECK, HEAD},
+        {SHOULDER_CENTER, SHOULDER_LEFT}, {SHOULDER_LEFT, ELBOW_LEFT},
+        {ELBOW_LEFT, WRIST_LEFT}, {WRIST_LEFT, HAND_LEFT},
+        {HAND_LEFT, HAND_TIP_LEFT}, {WRIST_LEFT, HAND_THUMB_LEFT},
+        {SHOULDER_CENTER, SHOULDER_RIGHT}, {SHOULDER_RIGHT, ELBOW_RIGHT},
+        {ELBOW_RIGHT, WRIST_RIGHT}, {WRIST_RIGHT, HAND_RIGHT},
+        {HAND_RIGHT, HAND_TIP_RIGHT}, {WRIST_RIGHT, HAND_THUMB_RIGHT},
+        {HIP_CENTER, HIP_LEFT}, {HIP_LEFT, KNEE_LEFT},
+        {KNEE_LEFT, ANKLE_LEFT}, {ANKLE_LEFT, FOOT_LEFT},
+        {HIP_CENTER, HIP_RIGHT}, {HIP_RIGHT, KNEE_RIGHT},
+        {KNEE_RIGHT, ANKLE_RIGHT}, {ANKLE_RIGHT, FOOT_RIGHT},
+    };
+
     const char* strFromType(DeviceType type)
     {
         switch (type)
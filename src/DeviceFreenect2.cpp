@@ -10,6 +10,8 @@
 #include "cinder/Log.h"
 #include "cinder/app/app.h"
 
+#include "DepthKernels.h"
+
 #ifdef _DEBUG
 #pragma comment(lib, "freenect2d.lib")
 #else
@@ -60,6 +62,11 @@ namespace ds
         unique_ptr<uint16_t[]> depthBuffer;
         unique_ptr<uint16_t[]> infraredBuffer;
 
+        // registration output, allocated once and rewritten every frame
+        unique_ptr<libfreenect2::Frame> undistorted, registered;
+        unique_ptr<uint16_t[]> undistortedBuffer;
+        vector<int> colorDepthMap;
+
         ivec2 kDepthSize = {512, 424};
         ivec2 kColorSize = {1920, 1080};
 
@@ -140,13 +147,47 @@ namespace ds
 
             if (option.enablePointCloud)
             {
-                registration = make_unique<libfreenect2::Registration>(dev->getIrCameraParams(),
-                                                                       dev->getColorCameraParams());
+                setupRegistration();
             }
 
             App::get()->getSignalUpdate().connect(std::bind(&DeviceFreenect2::update, this));
         }
 
+        void setupRegistration()
+        {
+            auto irParams = dev->getIrCameraParams();
+            registration =
+                make_unique<libfreenect2::Registration>(irParams, dev->getColorCameraParams());
+
+            undistorted = make_unique<libfreenect2::Frame>(kDepthSize.x, kDepthSize.y, 4);
+            undistortedBuffer.reset(new uint16_t[kDepthSize.x * kDepthSize.y]);
+            undistortedDepthChannel =
+                Channel16u(kDepthSize.x, kDepthSize.y, sizeof(uint16_t) * kDepthSize.x, 1,
+                           undistortedBuffer.get());
+
+            if (option.enableColor)
+            {
+                registered = make_unique<libfreenect2::Frame>(kDepthSize.x, kDepthSize.y, 4);
+                registeredColorSurface =
+                    Surface8u(registered->data, kDepthSize.x, kDepthSize.y,
+                              sizeof(uint8_t) * 4 * kDepthSize.x, SurfaceChannelOrder::BGRX);
+                colorDepthMap.resize(kDepthSize.x * kDepthSize.y);
+                depthToColorTable =
+                    Surface32f(kDepthSize.x, kDepthSize.y, false, SurfaceChannelOrder::RGB);
+            }
+
+            // Undistorted depth is a plain pinhole image, same convention as Registration::getPointXYZ()
+            depthToCameraTable = Surface32f(kDepthSize.x, kDepthSize.y, false, SurfaceChannelOrder::RGB);
+            for (int y = 0; y < kDepthSize.y; y++)
+                for (int x = 0; x < kDepthSize.x; x++)
+                {
+                    vec3* dst = (vec3*)depthToCameraTable.getData({x, y});
+                    dst->x = (x + 0.5f - irParams.cx) / irParams.fx;
+                    dst->y = (y + 0.5f - irParams.cy) / irParams.fy;
+                }
+            signalDepthToCameraTableDirty.emit();
+        }
+
         virtual ~DeviceFreenect2()
         {
             if (dev)
@@ -177,11 +218,7 @@ namespace ds
             {
                 assert(kDepthSize.x == depth->width);
                 assert(sizeof(float) == depth->bytes_per_pixel);
-                const float* src = (const float*)depth->data;
-                for (int i = 0; i < kDepthSize.x * kDepthSize.y; i++)
-                {
-                    depthBuffer[i] = src[i];
-                }
+                convertToU16(depthBuffer.get(), (const float*)depth->data, kDepthSize.x * kDepthSize.y);
                 signalDepthDirty.emit();
             }
 
@@ -199,19 +236,38 @@ namespace ds
             {
                 assert(kDepthSize.x == ir->width);
                 assert(sizeof(float) == ir->bytes_per_pixel);
-                const float* src = (const float*)ir->data;
-                for (int i = 0; i < kDepthSize.x * kDepthSize.y; i++)
-                {
-                    infraredBuffer[i] = src[i];
-                }
+                // IR amplitudes can exceed 65535, saturate rather than wrap
+                convertToU16(infraredBuffer.get(), (const float*)ir->data, kDepthSize.x * kDepthSize.y);
                 signalInfraredDirty.emit();
             }
 
-            if (option.enablePointCloud)
+            if (depth && option.enablePointCloud)
             {
-                libfreenect2::Frame undistorted(kDepthSize.x, kDepthSize.y, 4);
-                libfreenect2::Frame registered(kDepthSize.x, kDepthSize.y, 4);
-                registration->apply(rgb, depth, &undistorted, &registered);
+                if (rgb && registered)
+                {
+                    // color_depth_map comes out of the same pass, no need to map depth pixels again
+                    registration->apply(rgb, depth, undistorted.get(), registered.get(), true, nullptr,
+                                        colorDepthMap.data());
+
+                    // Texcoords address the centre of the color pixel, (p + 0.5) / size, like the other backends
+                    vec3* dst = (vec3*)depthToColorTable.getData();
+                    for (int i = 0; i < kDepthSize.x * kDepthSize.y; i++)
+                    {
+                        int index = colorDepthMap[i];
+                        dst[i].x = index < 0 ? 0 : (index % kColorSize.x + 0.5f) / (float)kColorSize.x;
+                        dst[i].y = index < 0 ? 0 : (index / kColorSize.x + 0.5f) / (float)kColorSize.y;
+                    }
+                    signalRegisteredColorDirty.emit();
+                    signalDepthToColorTableDirty.emit();
+                }
+                else
+                {
+                    registration->undistortDepth(depth, undistorted.get());
+                }
+
+                convertToU16(undistortedBuffer.get(), (const float*)undistorted->data,
+                             kDepthSize.x * kDepthSize.y);
+                signalUndistortedDepthDirty.emit();
             }
 
             listener->release(frames);
@@ -8,6 +8,10 @@
 #include "ImiCamera.h"
 #include "ImiNect.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #pragma comment(lib, "ImiCamera.lib")
 #pragma comment(lib, "ImiNect.lib")
 
@@ -23,17 +27,26 @@ using namespace std;
 
 namespace ds
 {
+    // The frame goes back to the SDK when the last handle to it is dropped
+    typedef shared_ptr<ImiImageFrame> ImiFrameRef;
+
     struct DeviceImi : public Device
     {
         ImiDeviceAttribute* pDeviceAttr = NULL;
         ImiDeviceHandle pImiDevice = NULL;
         // stream handles
-        uint32_t g_streamNum = 0;
-        ImiStreamHandle g_streams[10] = {NULL};
-        ImiStreamHandle depthHandle, colorHandle;
+        vector<ImiStreamHandle> streams;
+        ImiStreamHandle depthHandle = NULL, colorHandle = NULL;
         ivec2 depthSize;
         ivec2 colorSize;
 
+        // capture thread -> update thread handoff, latest frame per stream
+        thread captureThread;
+        atomic<bool> isCapturing;
+        mutex frameMutex;
+        ImiFrameRef pendingDepth, pendingColor;
+        ImiFrameRef depthFrame, colorFrame; // back the published channel / surface, update thread only
+
         virtual bool isValid() const { return pImiDevice != NULL; }
 
         ivec2 getDepthSize() const { return depthSize; }
@@ -42,12 +55,21 @@ namespace ds
 
         virtual ~DeviceImi()
         {
-            for (uint32_t num = 0; num < g_streamNum; ++num)
+            isCapturing = false;
+            if (captureThread.joinable())
             {
-                if (NULL != g_streams[num])
-                {
-                    imiCloseStream(g_streams[num]);
-                }
+                captureThread.join();
+            }
+
+            // frames have to go back before their streams are closed
+            pendingDepth.reset();
+            pendingColor.reset();
+            depthFrame.reset();
+            colorFrame.reset();
+
+            for (auto stream : streams)
+            {
+                imiCloseStream(stream);
             }
 
             // 7.imiCloseDevice()
@@ -66,7 +88,7 @@ namespace ds
             imiDestroy();
         }
 
-        DeviceImi(Option option)
+        DeviceImi(Option option) : isCapturing(false)
         {
             this->option = option;
 
@@ -106,7 +128,7 @@ namespace ds
                     CI_LOG_E("Open Depth Stream Failed!");
                     return;
                 }
-                g_streams[g_streamNum++] = depthHandle;
+                streams.push_back(depthHandle);
                 CI_LOG_I("Open Depth Stream Success.");
 
                 const ImiFrameMode* frameMode = imiGetCurrentFrameMode(pImiDevice, IMI_DEPTH_FRAME);
@@ -130,66 +152,81 @@ namespace ds
                     CI_LOG_E("Open Color Stream Failed!");
                     return;
                 }
-                g_streams[g_streamNum++] = colorHandle;
+                streams.push_back(colorHandle);
                 CI_LOG_I("Open Color Stream Success.");
 
                 const ImiFrameMode* frameMode = imiGetCurrentFrameMode(pImiDevice, IMI_COLOR_FRAME);
                 colorSize = {frameMode->resolutionX, frameMode->resolutionY};
             }
 
+            if (!streams.empty())
+            {
+                isCapturing = true;
+                captureThread = thread(&DeviceImi::capture, this);
+            }
+
             App::get()->getSignalUpdate().connect(std::bind(&DeviceImi::update, this));
         }
 
-        void update()
+        void capture()
         {
-            int32_t avStreamIndex;
-
-            // wait for stream, -1 means infinite;
-            if (imiWaitForStreams(g_streams, g_streamNum, &avStreamIndex, 100))
+            while (isCapturing)
             {
-                return;
+                int32_t avStreamIndex;
+
+                // wait for stream, -1 means infinite;
+                if (imiWaitForStreams(streams.data(), (int32_t)streams.size(), &avStreamIndex, 100))
+                {
+                    continue;
+                }
+
+                // Only one index is reported, but the other streams may be ready as well: drain them all
+                for (auto stream : streams)
+                {
+                    ImiImageFrame* pFrame = NULL;
+                    if (imiReadNextFrame(stream, &pFrame, 0) || pFrame == NULL)
+                    {
+                        continue;
+                    }
+
+                    ImiFrameRef frame(pFrame, [](ImiImageFrame* p) { imiReleaseFrame(&p); });
+                    lock_guard<mutex> lock(frameMutex);
+                    if (stream == depthHandle)
+                        pendingDepth = frame;
+                    else
+                        pendingColor = frame;
+                }
             }
+        }
 
-            /*CI_LOG_E("channel index : %d", avStreamIndex);*/
-            if ((avStreamIndex < 0) || ((uint32_t)avStreamIndex >= g_streamNum))
+        void update()
+        {
+            ImiFrameRef depth, color;
             {
-                CI_LOG_E("imiWaitForStream returns 0, but channel index abnormal: " << avStreamIndex);
-                return;
+                lock_guard<mutex> lock(frameMutex);
+                depth.swap(pendingDepth);
+                color.swap(pendingColor);
             }
 
-            if (option.enableDepth && g_streams[avStreamIndex] == depthHandle)
+            if (option.enableDepth && depth)
             {
-                ImiImageFrame* pFrame = NULL;
-                // frame coming, read.
-                if (imiReadNextFrame(g_streams[avStreamIndex], &pFrame, 0))
-                {
-                    CI_LOG_E("imiReadNextFrame Failed, channel index : " << avStreamIndex);
-                    return;
-                }
-                auto data = (uint16_t*)pFrame->pData;
+                depthFrame = depth;
+                auto data = (uint16_t*)depthFrame->pData;
                 depthChannel =
                     Channel16u(depthSize.x, depthSize.y, sizeof(uint16_t) * depthSize.x, 1, data);
 
                 signalDepthDirty.emit();
-                imiReleaseFrame(&pFrame);
             }
 
-            if (option.enableColor && g_streams[avStreamIndex] == colorHandle)
+            if (option.enableColor && color)
             {
-                ImiImageFrame* pFrame = NULL;
-                // frame coming, read.
-                if (imiReadNextFrame(g_streams[avStreamIndex], &pFrame, 0))
-                {
-                    CI_LOG_E("imiReadNextFrame Failed, channel index : ") << avStreamIndex;
-                    return;
-                }
-                CI_ASSERT(pFrame->pixelFormat == IMI_PIXEL_FORMAT_IMAGE_RGB24);
-                auto data = (uint8_t*)pFrame->pData;
+                colorFrame = color;
+                CI_ASSERT(colorFrame->pixelFormat == IMI_PIXEL_FORMAT_IMAGE_RGB24);
+                auto data = (uint8_t*)colorFrame->pData;
                 colorSurface =
                     Surface8u(data, colorSize.x, colorSize.y, sizeof(uint8_t) * 3 * colorSize.x,
                               SurfaceChannelOrder::RGB);
                 signalColorDirty.emit();
-                imiReleaseFrame(&pFrame);
             }
         }
 
@@ -7,6 +7,8 @@
 #include "cinder/app/app.h"
 #include "cinder/msw/CinderMsw.h"
 
+#include "TrackedSlots.h"
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
@@ -47,6 +49,7 @@ namespace ds
         KINECT_IMAGE_FRAME_FORMAT colorDesc;
 
         NUI_SKELETON_FRAME skeletonFrame;
+        TrackedSlots<Body> bodySlots;
         int sensor = KCB_INVALID_HANDLE;
 
         vector<NUI_COLOR_IMAGE_POINT> depthToColorArray;
@@ -76,6 +79,7 @@ namespace ds
         DeviceKinect1(Option option)
         {
             this->option = option;
+            bodySlots.setup(&bodies, NUI_SKELETON_COUNT);
 
             if (getDeviceCount() == 0)
             {
@@ -261,12 +265,15 @@ namespace ds
             {
                 if (SUCCEEDED(KinectGetSkeletonFrame(sensor, &skeletonFrame)))
                 {
+                    bodySlots.begin();
                     for (auto& data : skeletonFrame.SkeletonData)
                     {
                         if (data.eTrackingState != NUI_SKELETON_TRACKED)
                             continue;
-                        Body body;
-                        body.id = data.dwTrackingID;
+                        Body* slot = bodySlots.acquire(data.dwTrackingID);
+                        if (slot == nullptr)
+                            continue;
+                        Body& body = *slot;
 
                         for (auto& mapping : mappingPairs)
                         {
@@ -291,9 +298,22 @@ namespace ds
                             }
                             body.joints[mapping.first].pos3d = pos3d;
                             body.joints[mapping.first].pos2d = pos2d;
+
+                            switch (data.eSkeletonPositionTrackingState[mapping.second])
+                            {
+                            case NUI_SKELETON_POSITION_TRACKED:
+                                body.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_HIGH;
+                                break;
+                            case NUI_SKELETON_POSITION_INFERRED:
+                                body.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_LOW;
+                                break;
+                            default:
+                                body.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_NONE;
+                                break;
+                            }
                         }
-                        bodies.push_back(body);
                     }
+                    bodySlots.end();
                     signalBodyDirty.emit();
                 }
             }
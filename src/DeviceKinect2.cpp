@@ -10,6 +10,8 @@
 #include "cinder/app/app.h"
 #include "cinder/msw/CinderMsw.h"
 
+#include "TrackedSlots.h"
+
 #pragma comment(lib, "Kinect20.Face.lib")
 
 using namespace ci;
@@ -80,6 +82,9 @@ namespace ds
         };
         HDFaceInternal hdFaces[BODY_COUNT] = {};
 
+        TrackedSlots<Body> bodySlots;
+        TrackedSlots<Face> faceSlots;
+
         vector<ColorSpacePoint> depthToColorArray;
 
         static uint32_t getDeviceCount() { return 1; }
@@ -135,6 +140,7 @@ namespace ds
                 // face is dependent on body
                 this->option.enableBody = true;
             }
+            bodySlots.setup(&bodies, BODY_COUNT);
 
             HRESULT hr = S_OK;
 
@@ -254,10 +260,9 @@ namespace ds
                 {
                     uint32_t vertexCount;
                     hr = ::GetFaceModelVertexCount(&vertexCount); // 1347
-                    for (int i = 0; i < BODY_COUNT; i++)
-                    {
-                        faces[i].vertices.resize(vertexCount);
-                    }
+                    Face prototype;
+                    prototype.vertices.resize(vertexCount);
+                    faceSlots.setup(&faces, BODY_COUNT, prototype);
 
                     uint32_t indexCount;
                     hr = ::GetFaceModelTriangleCount(&indexCount);
@@ -363,25 +368,35 @@ namespace ds
                 if (SUCCEEDED(KCBGetBodyData(sensor, BODY_COUNT, srcBodies, &timeStamp)))
                 {
                     HRESULT hr = S_OK;
-                    bodies.clear();
+                    bodySlots.begin();
+                    if (option.enableFace)
+                        faceSlots.begin();
                     for (int i = 0; i < BODY_COUNT; i++)
                     {
                         SCOPED_COM_OBJECT(srcBodies[i]);
                         Body body;
                         if (!updateBody(srcBodies[i], body))
                             continue;
-                        bodies.push_back(body);
+                        Body* bodySlot = bodySlots.acquire(body.id);
+                        if (bodySlot == nullptr)
+                            continue;
+                        *bodySlot = body;
 
                         if (!option.enableFace)
                             continue;
 
-                        Face face;
-                        if (!updateFace(body, hdFaces[i], face))
-                            continue;
-                        faces.push_back(face);
+                        Face* face = faceSlots.acquire(body.id);
+                        if (face != nullptr && !updateFace(body, hdFaces[i], *face))
+                            faceSlots.release(face);
                     }
-
+                    bodySlots.end();
                     signalBodyDirty.emit();
+
+                    if (option.enableFace)
+                    {
+                        faceSlots.end();
+                        signalFaceDirty.emit();
+                    }
                 }
             }
         }
@@ -528,6 +543,19 @@ namespace ds
                 depthPoint.X /= depthDesc.width;
                 depthPoint.Y /= depthDesc.height;
                 dst.joints[mapping.first].pos2d = toCi(depthPoint);
+
+                switch (srcJoints[mapping.second].TrackingState)
+                {
+                case TrackingState_Tracked:
+                    dst.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_HIGH;
+                    break;
+                case TrackingState_Inferred:
+                    dst.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_LOW;
+                    break;
+                default:
+                    dst.joints[mapping.first].confidence = Body::JOINT_CONFIDENCE_NONE;
+                    break;
+                }
             }
 
             return true;
@@ -12,6 +12,19 @@
 #include "k4a/k4a.h"
 #include "k4a/k4abt.h"
 
+#include "BufferPool.h"
+#include "ColorKernels.h"
+#include "DepthKernels.h"
+#include "TrackedSlots.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
 #pragma comment(lib, "k4a")
 #pragma comment(lib, "k4abt")
 
@@ -55,6 +68,44 @@ namespace ds
         {Body::EAR_RIGHT, K4ABT_JOINT_EAR_RIGHT} ,
     };
 
+    static k4a_image_format_t toK4a(Option::ColorFormat format)
+    {
+        switch (format)
+        {
+        case Option::COLOR_MJPG:
+            return K4A_IMAGE_FORMAT_COLOR_MJPG;
+        case Option::COLOR_NV12:
+            return K4A_IMAGE_FORMAT_COLOR_NV12;
+        case Option::COLOR_YUY2:
+            return K4A_IMAGE_FORMAT_COLOR_YUY2;
+        default:
+            return K4A_IMAGE_FORMAT_COLOR_BGRA32;
+        }
+    }
+
+    // Smallest mode at least as tall as requested
+    static k4a_color_resolution_t toK4aColorResolution(int height)
+    {
+        static const std::pair<int, k4a_color_resolution_t> modes[] = {
+            {720, K4A_COLOR_RESOLUTION_720P},   {1080, K4A_COLOR_RESOLUTION_1080P},
+            {1440, K4A_COLOR_RESOLUTION_1440P}, {1536, K4A_COLOR_RESOLUTION_1536P},
+            {2160, K4A_COLOR_RESOLUTION_2160P},
+        };
+        for (auto& mode : modes)
+        {
+            if (height <= mode.first)
+                return mode.second;
+        }
+        return K4A_COLOR_RESOLUTION_3072P;
+    }
+
+    static k4a_depth_mode_t toK4aDepthMode(const Option& option)
+    {
+        if (option.wideFieldOfView)
+            return option.binnedDepth ? K4A_DEPTH_MODE_WFOV_2X2BINNED : K4A_DEPTH_MODE_WFOV_UNBINNED;
+        return option.binnedDepth ? K4A_DEPTH_MODE_NFOV_2X2BINNED : K4A_DEPTH_MODE_NFOV_UNBINNED;
+    }
+
     vec2 toCi(const k4a_float2_t& float2)
     {
         return { float2.v[0], float2.v[1] };
@@ -70,9 +121,39 @@ namespace ds
         return { oritention.v[0], oritention.v[1], oritention.v[2], oritention.v[3]};
     }
 
+    // Ref-counted SDK handles, released when the last owner lets go
+    typedef shared_ptr<remove_pointer<k4a_capture_t>::type> CaptureRef;
+    typedef shared_ptr<remove_pointer<k4a_image_t>::type> ImageRef;
+    typedef shared_ptr<remove_pointer<k4abt_frame_t>::type> BodyFrameRef;
+
+    // Color decoded on the worker pool
+    struct ColorResult
+    {
+        shared_ptr<uint8_t> buffer; // pooled storage of surface, empty when the decoder allocated it
+        Surface8u surface;
+        uint64_t timestamp = 0;
+    };
+
+    // Depth in color and color in depth, transformed on the registration thread. Either may be missing.
+    struct RegistrationResult
+    {
+        Channel16u depth;
+        shared_ptr<uint8_t> colorBuffer; // pooled storage of color
+        Surface8u color;
+    };
+
+    // Tracker output, converted on the tracker thread. Recycled once the update thread lets go of it, bodies keeps
+    // its capacity.
+    struct BodyResult
+    {
+        BodyFrameRef frame; // owns the body index map
+        vector<Body> bodies;
+        uint64_t timestamp = 0;
+    };
+
     struct DeviceKinectAzure : public Device
     {
-        virtual bool isValid() const { return true; }
+        virtual bool isValid() const { return device_handle != 0; }
 
         ivec2 getDepthSize() const { return depthSize; }
 
@@ -81,6 +162,7 @@ namespace ds
         DeviceKinectAzure(Option option)
         {
             this->option = option;
+            bodySlots.setup(&bodies, kMaxBodies);
             k4a_result_t result = k4a_device_open(option.deviceId, &device_handle);
             if (result != K4A_RESULT_SUCCEEDED)
                 return;
@@ -88,8 +170,15 @@ namespace ds
             k4a_device_configuration_t conf = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
             if (option.enableColor)
             {
-                conf.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
-                conf.color_resolution = K4A_COLOR_RESOLUTION_1080P;
+                conf.color_format = toK4a(option.colorFormat);
+                conf.color_resolution = toK4aColorResolution(option.colorHeight > 0 ? option.colorHeight : 1080);
+                if ((conf.color_format == K4A_IMAGE_FORMAT_COLOR_NV12 ||
+                     conf.color_format == K4A_IMAGE_FORMAT_COLOR_YUY2) &&
+                    conf.color_resolution != K4A_COLOR_RESOLUTION_720P)
+                {
+                    CI_LOG_W("NV12 and YUY2 are 720p only");
+                    conf.color_resolution = K4A_COLOR_RESOLUTION_720P;
+                }
             }
             if (option.enableInfrared)
             {
@@ -97,39 +186,409 @@ namespace ds
             }
             if (option.enableDepth)
             {
-                conf.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
+                conf.depth_mode = toK4aDepthMode(option);
+            }
+            conf.camera_fps = option.fps <= 0    ? K4A_FRAMES_PER_SECOND_30
+                              : option.fps <= 5  ? K4A_FRAMES_PER_SECOND_5
+                              : option.fps <= 15 ? K4A_FRAMES_PER_SECOND_15
+                                                 : K4A_FRAMES_PER_SECOND_30;
+            if (conf.camera_fps == K4A_FRAMES_PER_SECOND_30 &&
+                (conf.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED || conf.color_resolution == K4A_COLOR_RESOLUTION_3072P))
+            {
+                CI_LOG_W("Unbinned WFOV depth and 3072p color run at 15 fps at most");
+                conf.camera_fps = K4A_FRAMES_PER_SECOND_15;
             }
-            conf.camera_fps = K4A_FRAMES_PER_SECOND_30;
             conf.wired_sync_mode = K4A_WIRED_SYNC_MODE_STANDALONE;
 
             k4a_result_t startResult = k4a_device_start_cameras(device_handle, &conf);
             if (startResult != K4A_RESULT_SUCCEEDED)
+            {
+                k4a_device_close(device_handle);
+                device_handle = 0;
                 return;
+            }
+
+            bool hasCalibration = k4a_device_get_calibration(device_handle, conf.depth_mode, conf.color_resolution,
+                                                             &calibration) == K4A_RESULT_SUCCEEDED;
+            if (!hasCalibration)
+                CI_LOG_E("Failed to read the device calibration");
 
             if (option.enableBody || option.enableBodyIndex)
             {
-                result = k4a_device_get_calibration(device_handle,
-                    conf.depth_mode,
-                    conf.color_resolution,
-                    &calibration);
                 k4abt_tracker_configuration_t cfg = K4ABT_TRACKER_CONFIG_DEFAULT;
-                result = k4abt_tracker_create(&calibration,
-                    cfg,
-                    &tracker);
+                if (!hasCalibration ||
+                    k4abt_tracker_create(&calibration, cfg, &tracker) != K4A_RESULT_SUCCEEDED)
+                {
+                    CI_LOG_E("Failed to create the body tracker");
+                    tracker = nullptr;
+                }
+            }
+
+            if (hasCalibration && option.enablePointCloud && option.enableDepth)
+            {
+                setupPointCloud();
+            }
+
+            // Anything but full size BGRA is converted here rather than by the SDK, on as many threads as it takes
+            // to keep up with the sensor
+            colorScale = option.colorDecodeScale >= 4 ? 4 : option.colorDecodeScale >= 2 ? 2 : 1;
+            if (option.enableColor && (conf.color_format != K4A_IMAGE_FORMAT_COLOR_BGRA32 || colorScale > 1))
+            {
+                decodePool.start(max(1u, min(4u, thread::hardware_concurrency())));
+            }
+            // The SDK transformations take several ms per frame, keep them off the capture and update threads
+            if (transformation)
+            {
+                registrationPool.start(1);
             }
+
+            isRunning = true;
+            captureThread = thread(&DeviceKinectAzure::captureLoop, this);
+            if (tracker)
+                trackerThread = thread(&DeviceKinectAzure::trackerLoop, this);
+
             App::get()->getSignalUpdate().connect(std::bind(&DeviceKinectAzure::update, this));
         }
 
         ~DeviceKinectAzure()
         {
+            isRunning = false;
+            if (tracker)
+            {
+                // wakes up a pending pop_result
+                k4abt_tracker_shutdown(tracker);
+            }
+            if (captureThread.joinable())
+                captureThread.join();
+            if (trackerThread.joinable())
+                trackerThread.join();
+            decodePool.stop();
+            registrationPool.stop();
+
+            pendingCapture.reset();
+            colorCapture.reset();
+            depthCapture.reset();
+            infraredCapture.reset();
+            pendingRegistration.reset();
+            pendingBodies.reset();
+            bodyIndexFrame.reset();
+            bodyResults.clear();
+
+            if (tracker)
+            {
+                k4abt_tracker_destroy(tracker);
+            }
+            if (transformation)
+            {
+                k4a_transformation_destroy(transformation);
+            }
             if (device_handle)
             {
                 k4a_device_stop_cameras(device_handle);
                 k4a_device_close(device_handle);
             }
-            if (tracker)
+        }
+
+        // Both tables only depend on the calibration. depthToCameraTable holds the unit ray of every depth pixel as
+        // found by the SDK's iterative unprojection; depth-to-color then reprojects those rays per frame.
+        void setupPointCloud()
+        {
+            const auto& depthCamera = calibration.depth_camera_calibration;
+            const int width = depthCamera.resolution_width, height = depthCamera.resolution_height;
+
+            vector<float> rays(width * height * 2);
+            depthToCameraTable = Surface32f(width, height, false, SurfaceChannelOrder::RGB);
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                {
+                    k4a_float2_t p2d = {{(float)x, (float)y}};
+                    k4a_float3_t p3d;
+                    int valid = 0;
+                    float* ray = &rays[(y * width + x) * 2];
+                    ray[0] = ray[1] = 0;
+                    if (k4a_calibration_2d_to_3d(&calibration, &p2d, 1000.0f, K4A_CALIBRATION_TYPE_DEPTH,
+                                                 K4A_CALIBRATION_TYPE_DEPTH, &p3d, &valid) == K4A_RESULT_SUCCEEDED &&
+                        valid)
+                    {
+                        ray[0] = p3d.xyz.x / 1000.0f;
+                        ray[1] = p3d.xyz.y / 1000.0f;
+                    }
+                    vec3* dst = (vec3*)depthToCameraTable.getData({x, y});
+                    dst->x = ray[0];
+                    dst->y = ray[1];
+                }
+            signalDepthToCameraTableDirty.emit();
+
+            if (!option.enableColor)
+                return;
+
+            const auto& colorCamera = calibration.color_camera_calibration;
+            const auto& param = colorCamera.intrinsics.parameters.param;
+            if (colorCamera.intrinsics.type != K4A_CALIBRATION_LENS_DISTORTION_MODEL_BROWN_CONRADY)
             {
-                k4abt_tracker_destroy(tracker);
+                CI_LOG_W("Unsupported color lens model " << colorCamera.intrinsics.type << ", no depthToColorTable");
+            }
+            else
+            {
+                PinholeIntrinsics color;
+                color.width = colorCamera.resolution_width;
+                color.height = colorCamera.resolution_height;
+                color.ppx = param.cx;
+                color.ppy = param.cy;
+                color.fx = param.fx;
+                color.fy = param.fy;
+                color.model = PinholeIntrinsics::RATIONAL_BROWN_CONRADY;
+                const float coeffs[] = {param.k1, param.k2, param.k3, param.k4, param.k5, param.k6, param.p1, param.p2};
+                copy(coeffs, coeffs + 8, color.coeffs);
+                color.maxRadius = param.metric_radius;
+
+                // k4a extrinsics are row-major and in mm
+                const auto& extrinsics = calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR];
+                float rotation[9], translation[3];
+                for (int r = 0; r < 3; r++)
+                {
+                    for (int c = 0; c < 3; c++)
+                        rotation[c * 3 + r] = extrinsics.rotation[r * 3 + c];
+                    translation[r] = extrinsics.translation[r] / 1000.0f;
+                }
+
+                depthToColorMapper.setup(width, height, rays.data(), rotation, translation, 0.001f, color);
+                depthToColorTable = Surface32f(width, height, false, SurfaceChannelOrder::RGB);
+                checkDepthToColorMapper();
+            }
+
+            transformation = k4a_transformation_create(&calibration);
+            if (!transformation)
+                CI_LOG_E("Failed to create the depth / color transformation");
+        }
+
+        // The mapper reimplements the SDK's projection, compare both on a sparse grid so a calibration it does
+        // not model shows up in the log rather than as a misaligned pointcloud.
+        void checkDepthToColorMapper()
+        {
+            const int width = depthToColorMapper.width, height = depthToColorMapper.height;
+            const int kStep = 16;
+            const uint16_t kDepths[] = {500, 1500, 4000};
+
+            vector<uint16_t> depth(width * height);
+            vector<float> texcoords(width * height * 3);
+            float maxError = 0;
+            for (uint16_t d : kDepths)
+            {
+                for (int y = 0; y < height; y += kStep)
+                    for (int x = 0; x < width; x += kStep)
+                        depth[y * width + x] = d;
+                depthToColorMapper.process(texcoords.data(), depth.data());
+
+                for (int y = 0; y < height; y += kStep)
+                    for (int x = 0; x < width; x += kStep)
+                    {
+                        k4a_float2_t src = {{(float)x, (float)y}}, dst;
+                        int valid = 0;
+                        if (k4a_calibration_2d_to_2d(&calibration, &src, d, K4A_CALIBRATION_TYPE_DEPTH,
+                                                     K4A_CALIBRATION_TYPE_COLOR, &dst, &valid) != K4A_RESULT_SUCCEEDED ||
+                            !valid)
+                            continue;
+                        const float* uv = &texcoords[(y * width + x) * 3];
+                        if (uv[0] == 0 && uv[1] == 0)
+                            continue;
+                        const auto& color = depthToColorMapper.color;
+                        maxError = max(maxError, abs(uv[0] * color.width - 0.5f - dst.xy.x));
+                        maxError = max(maxError, abs(uv[1] * color.height - 0.5f - dst.xy.y));
+                    }
+            }
+
+            if (maxError > 0.5f)
+                CI_LOG_W("depthToColorTable is off by up to " << maxError << " color pixels");
+        }
+
+        // Runs at sensor rate. Captures go to the tracker without waiting for it: when its queue is full the
+        // capture is only displayed, so a slow tracker lowers the body rate but not the frame rate.
+        void captureLoop()
+        {
+            const int32_t TIMEOUT_IN_MS = 100;
+
+            while (isRunning)
+            {
+                k4a_capture_t capture_handle;
+                if (k4a_device_get_capture(device_handle, &capture_handle, TIMEOUT_IN_MS) != K4A_WAIT_RESULT_SUCCEEDED)
+                    continue;
+
+                if (tracker)
+                    k4abt_tracker_enqueue_capture(tracker, capture_handle, 0);
+                if (decodePool.threadCount() > 0)
+                    submitColor(capture_handle);
+
+                CaptureRef capture(capture_handle, k4a_capture_release);
+                if (registrationPool.threadCount() > 0)
+                {
+                    // skipped while the previous frame is still being registered
+                    registrationPool.run([this, capture] { registerCapture(capture.get()); }, 1);
+                }
+                lock_guard<mutex> lock(captureMutex);
+                pendingCapture.swap(capture);
+            }
+        }
+
+        // With every worker still busy the frame is skipped, the next one is newer anyway
+        void submitColor(k4a_capture_t capture_handle)
+        {
+            k4a_image_t image = k4a_capture_get_color_image(capture_handle);
+            if (image == 0)
+                return;
+
+            ImageRef ref(image, k4a_image_release);
+            decodePool.run([this, ref] { decodeColor(ref.get()); }, decodePool.threadCount());
+        }
+
+        // Runs on the decode pool
+        void decodeColor(k4a_image_t image)
+        {
+            const int width = k4a_image_get_width_pixels(image);
+            const int height = k4a_image_get_height_pixels(image);
+            const int stride = k4a_image_get_stride_bytes(image);
+            const uint8_t* src = k4a_image_get_buffer(image);
+            const int dstWidth = width / colorScale, dstHeight = height / colorScale;
+            const auto format = k4a_image_get_format(image);
+
+            auto result = make_shared<ColorResult>();
+            result->timestamp = k4a_image_get_device_timestamp_usec(image);
+
+            Surface8u decoded;
+            if (format == K4A_IMAGE_FORMAT_COLOR_MJPG)
+            {
+                // the decoder works at full size, only the copy below gets cheaper with colorScale
+                try
+                {
+                    auto source = DataSourceBuffer::create(Buffer::create((void*)src, k4a_image_get_size(image)));
+                    decoded = Surface8u(loadImage(source, ImageSource::Options(), "jpg"), SurfaceConstraintsDefault(), true);
+                }
+                catch (const std::exception& e)
+                {
+                    CI_LOG_W("Failed to decode a color frame: " << e.what());
+                    return;
+                }
+
+                if (colorScale == 1)
+                    result->surface = decoded;
+            }
+
+            if (!result->surface)
+            {
+                {
+                    lock_guard<mutex> lock(colorPoolMutex);
+                    result->buffer = colorPool.acquire(dstWidth * dstHeight * 4);
+                }
+                uint8_t* dst = result->buffer.get();
+                SurfaceChannelOrder order = SurfaceChannelOrder::BGRX;
+                switch (format)
+                {
+                case K4A_IMAGE_FORMAT_COLOR_NV12:
+                    convertNV12ToBGRA(dst, dstWidth * 4, src, stride, width, height, colorScale);
+                    break;
+                case K4A_IMAGE_FORMAT_COLOR_YUY2:
+                    convertYUY2ToBGRA(dst, dstWidth * 4, src, stride, width, height, colorScale);
+                    break;
+                case K4A_IMAGE_FORMAT_COLOR_MJPG:
+                    order = decoded.getChannelOrder();
+                    downscale4(dst, dstWidth * 4, decoded.getData(), decoded.getRowBytes(), width, height, colorScale);
+                    break;
+                case K4A_IMAGE_FORMAT_COLOR_BGRA32:
+                    downscale4(dst, dstWidth * 4, src, stride, width, height, colorScale);
+                    break;
+                default:
+                    return;
+                }
+                result->surface = Surface8u(dst, dstWidth, dstHeight, dstWidth * 4, order);
+            }
+
+            // workers can finish out of order
+            lock_guard<mutex> lock(colorMutex);
+            if (!pendingColor || pendingColor->timestamp < result->timestamp)
+                pendingColor.swap(result);
+        }
+
+        void trackerLoop()
+        {
+            const int32_t TIMEOUT_IN_MS = 100;
+
+            while (isRunning)
+            {
+                k4abt_frame_t body_frame_handle = nullptr;
+                auto waitResult = k4abt_tracker_pop_result(tracker, &body_frame_handle, TIMEOUT_IN_MS);
+                if (waitResult == K4A_WAIT_RESULT_FAILED)
+                    break;
+                if (waitResult != K4A_WAIT_RESULT_SUCCEEDED || body_frame_handle == nullptr)
+                    continue;
+
+                auto result = acquireBodyResult();
+                result->frame = BodyFrameRef(body_frame_handle, k4abt_frame_release);
+                result->timestamp = k4abt_frame_get_device_timestamp_usec(body_frame_handle);
+                if (option.enableBody)
+                    readBodies(body_frame_handle, result->bodies);
+
+                lock_guard<mutex> lock(bodyMutex);
+                pendingBodies.swap(result);
+            }
+        }
+
+        // Tracker thread only. At most three results are alive: pending, the one update() is reading and the one
+        // being filled.
+        shared_ptr<BodyResult> acquireBodyResult()
+        {
+            for (auto& result : bodyResults)
+            {
+                if (result.use_count() == 1)
+                {
+                    result->frame.reset();
+                    result->bodies.clear();
+                    return result;
+                }
+            }
+            bodyResults.push_back(make_shared<BodyResult>());
+            bodyResults.back()->bodies.reserve(kMaxBodies);
+            return bodyResults.back();
+        }
+
+        void readBodies(k4abt_frame_t body_frame_handle, vector<Body>& bodies)
+        {
+            const auto& depthCamera = calibration.depth_camera_calibration;
+            uint32_t num_bodies = min(k4abt_frame_get_num_bodies(body_frame_handle), (uint32_t)kMaxBodies);
+            for (uint32_t i = 0; i < num_bodies; i++)
+            {
+                k4abt_skeleton_t skeleton;
+                auto result = k4abt_frame_get_body_skeleton(body_frame_handle, i, &skeleton);
+                if (result == K4A_RESULT_SUCCEEDED)
+                {
+                    Body body;
+                    body.id = k4abt_frame_get_body_id(body_frame_handle, i);
+                    for (auto& mapping : mappingPairs)
+                    {
+                        const auto& srcJoint = skeleton.joints[mapping.second];
+                        auto& dstJoint = body.joints[mapping.first];
+                        const k4a_float3_t& jointPosition = srcJoint.position;
+                        const k4a_quaternion_t& jointOrientation = srcJoint.orientation;
+                        // k4abt works in mm, Body::Joint is in meters and normalized depth image coordinates
+                        dstJoint.pos3d = toCi(jointPosition) * 0.001f;
+
+                        int valid = 0;
+                        k4a_float2_t pos2d;
+                        auto calib_result = k4a_calibration_3d_to_2d(&calibration,
+                            &jointPosition,
+                            K4A_CALIBRATION_TYPE_DEPTH,
+                            K4A_CALIBRATION_TYPE_DEPTH,
+                            &pos2d,
+                            &valid);
+                        dstJoint.pos2d = calib_result == K4A_RESULT_SUCCEEDED && valid
+                                             ? toCi(pos2d) / vec2(depthCamera.resolution_width,
+                                                                  depthCamera.resolution_height)
+                                             : vec2(0);
+
+                        dstJoint.orientation = toCi(jointOrientation);
+                        dstJoint.confidence = (Body::JointConfidence)srcJoint.confidence_level;
+                    }
+                    bodies.emplace_back(body);
+                }
             }
         }
 
@@ -138,14 +597,68 @@ namespace ds
             if (device_handle == 0)
                 return;
 
-            const int32_t TIMEOUT_IN_MS = 1000;
+            CaptureRef capture;
+            {
+                lock_guard<mutex> lock(captureMutex);
+                capture.swap(pendingCapture);
+            }
+            if (capture)
+            {
+                updateImages(capture);
+            }
 
-            k4a_capture_t capture_handle;
-            k4a_wait_result_t waiResult = k4a_device_get_capture(device_handle, &capture_handle, TIMEOUT_IN_MS);
+            shared_ptr<ColorResult> colorResult;
+            {
+                lock_guard<mutex> lock(colorMutex);
+                colorResult.swap(pendingColor);
+            }
+            if (colorResult && colorResult->timestamp > colorTimestamp)
+            {
+                frontColor = colorResult;
+                colorTimestamp = colorResult->timestamp;
+                colorSurface = colorResult->surface;
+                colorSize = {colorSurface.getWidth(), colorSurface.getHeight(), (int)colorSurface.getRowBytes()};
+                signalColorDirty.emit();
+            }
 
-            if (waiResult != K4A_WAIT_RESULT_SUCCEEDED) return;
+            shared_ptr<RegistrationResult> registrationResult;
+            {
+                lock_guard<mutex> lock(registrationMutex);
+                registrationResult.swap(pendingRegistration);
+            }
+            if (registrationResult)
+            {
+                if (registrationResult->depth)
+                {
+                    registeredDepthChannel = registrationResult->depth;
+                    signalRegisteredDepthDirty.emit();
+                }
+                if (registrationResult->color)
+                {
+                    // Surface8u can't share ownership, keep the buffer until the next one replaces it
+                    registeredColorBuffer = registrationResult->colorBuffer;
+                    registeredColorSurface = registrationResult->color;
+                    signalRegisteredColorDirty.emit();
+                }
+            }
 
-            if (option.enableColor)
+            shared_ptr<BodyResult> bodyResult;
+            {
+                lock_guard<mutex> lock(bodyMutex);
+                bodyResult.swap(pendingBodies);
+            }
+            if (bodyResult)
+            {
+                updateBodies(*bodyResult);
+            }
+        }
+
+        // Published channels point into the capture. Each one keeps its own reference, so a capture that lacks
+        // an image leaves the previous one (and the capture behind it) in place rather than dangling.
+        void updateImages(const CaptureRef& capture)
+        {
+            k4a_capture_t capture_handle = capture.get();
+            if (option.enableColor && decodePool.threadCount() == 0)
             {
                 auto image = k4a_capture_get_color_image(capture_handle);
                 if (image != 0)
@@ -158,6 +671,7 @@ namespace ds
                     }
                     auto ptr = k4a_image_get_buffer(image);
                     colorSurface = Surface8u(ptr, colorSize.x, colorSize.y, colorSize.z, SurfaceChannelOrder::BGRX);
+                    colorCapture = capture;
                     signalColorDirty.emit();
                     k4a_image_release(image);
                 }
@@ -178,93 +692,17 @@ namespace ds
                     if (ptr != nullptr)
                     {
                         depthChannel = Channel16u(depthSize.x, depthSize.y, depthSize.z, 1, ptr);
+                        depthCapture = capture;
                         signalDepthDirty.emit();
-                    }
-                    k4a_image_release(image);
-                }
-            }
-
-            if (option.enableBody || option.enableBodyIndex)
-            {
-                k4abt_frame_t body_frame_handle = nullptr;
-
-                [&] {
-                    auto result = k4abt_tracker_enqueue_capture(tracker,
-                        capture_handle,
-                        TIMEOUT_IN_MS);
-
-                    if (result != K4A_WAIT_RESULT_SUCCEEDED)
-                        return;
 
-                    result = k4abt_tracker_pop_result(tracker,
-                        &body_frame_handle,
-                        TIMEOUT_IN_MS);
-                    if (result != K4A_WAIT_RESULT_SUCCEEDED || body_frame_handle == nullptr)
-                        return;
-
-                    if (option.enableBody)
-                    {
-                        uint32_t num_bodies = k4abt_frame_get_num_bodies(body_frame_handle);
-                        if (num_bodies == 0)
-                            return;
-                        CI_LOG_I(num_bodies << " bodies are detected");
-                        vector<Body> bodies;
-                        for (int i = 0; i < num_bodies; i++)
+                        if (depthToColorMapper.width == depthSize.x && depthSize.z == depthSize.x * 2)
                         {
-                            k4abt_skeleton_t skeleton;
-                            auto result = k4abt_frame_get_body_skeleton(body_frame_handle, i, &skeleton);
-                            if (result == K4A_RESULT_SUCCEEDED)
-                            {
-                                Body body;
-                                body.id = k4abt_frame_get_body_id(body_frame_handle, i);
-                                for (auto& mapping : mappingPairs)
-                                {
-                                    const auto& srcJoint = skeleton.joints[mapping.second];
-                                    auto& dstJoint = body.joints[mapping.first];
-                                    const k4a_float3_t& jointPosition = srcJoint.position;
-                                    const k4a_quaternion_t& jointOrientation = srcJoint.orientation;
-                                    dstJoint.pos3d = toCi(jointPosition);
-
-                                    int valid = 0;
-                                    k4a_float2_t pos2d;
-                                    auto calib_result = k4a_calibration_3d_to_2d(&calibration,
-                                        &jointPosition,
-                                        K4A_CALIBRATION_TYPE_DEPTH,
-                                        K4A_CALIBRATION_TYPE_COLOR,
-                                        &pos2d,
-                                        &valid);
-                                    dstJoint.pos2d = toCi(pos2d);
-
-                                    dstJoint.orientation = toCi(jointOrientation);
-                                    dstJoint.confidence = (Body::JointConfidence)srcJoint.confidence_level;
-                                }
-                                bodies.emplace_back(body);
-                            }
+                            depthToColorMapper.process(depthToColorTable.getData(), ptr);
+                            signalDepthToColorTableDirty.emit();
                         }
                     }
-                    if (option.enableBodyIndex)
-                    {
-                        k4a_image_t image = k4abt_frame_get_body_index_map(body_frame_handle);
-                        if (image != 0)
-                        {
-                            if (bodyIndexSize.x == 0 || bodyIndexSize.y == 0)
-                            {
-                                bodyIndexSize.x = k4a_image_get_width_pixels(image);
-                                bodyIndexSize.y = k4a_image_get_height_pixels(image);
-                                bodyIndexSize.z = k4a_image_get_stride_bytes(image);
-                            }
-                            auto ptr = (uint8_t*)k4a_image_get_buffer(image);
-                            if (ptr != nullptr)
-                            {
-                                bodyIndexChannel = Channel8u(bodyIndexSize.x, bodyIndexSize.y, bodyIndexSize.z, 1, ptr);
-                                signalBodyIndexDirty.emit();
-                            }
-                            k4a_image_release(image);
-                        }
-                    }
-                }();
-                if (body_frame_handle)
-                    k4abt_frame_release(body_frame_handle);
+                    k4a_image_release(image);
+                }
             }
 
             if (option.enableInfrared)
@@ -280,18 +718,158 @@ namespace ds
                     }
                     uint16_t* ptr = (uint16_t*)k4a_image_get_buffer(image);
                     infraredChannel = Channel16u(depthSize.x, depthSize.y, depthSize.z, 1, ptr);
+                    infraredCapture = capture;
 
                     signalInfraredDirty.emit();
                     k4a_image_release(image);
                 }
             }
-            k4a_capture_release(capture_handle);
+        }
+
+        // Runs on the registration thread, one frame at a time
+        void registerCapture(k4a_capture_t capture_handle)
+        {
+            k4a_image_t depth = k4a_capture_get_depth_image(capture_handle);
+            if (depth == 0)
+                return;
+
+            // color-in-depth takes BGRA at the calibrated size, i.e. what the SDK decodes
+            k4a_image_t color = decodePool.threadCount() == 0 ? k4a_capture_get_color_image(capture_handle) : 0;
+            auto result = make_shared<RegistrationResult>();
+            transformImages(depth, color, *result);
+            k4a_image_release(depth);
+            if (color != 0)
+                k4a_image_release(color);
+
+            if (result->depth || result->color)
+            {
+                lock_guard<mutex> lock(registrationMutex);
+                pendingRegistration.swap(result);
+            }
+        }
+
+        // The SDK writes into pooled buffers wrapped as k4a images, so the images themselves allocate nothing per
+        // frame
+        void transformImages(k4a_image_t depth, k4a_image_t color, RegistrationResult& result)
+        {
+            const int colorWidth = calibration.color_camera_calibration.resolution_width;
+            const int colorHeight = calibration.color_camera_calibration.resolution_height;
+            const int depthWidth = k4a_image_get_width_pixels(depth);
+            const int depthHeight = k4a_image_get_height_pixels(depth);
+
+            k4a_image_t output = 0;
+            auto depthInColor = registeredDepthPool.acquireChannel(colorWidth, colorHeight);
+            if (k4a_image_create_from_buffer(K4A_IMAGE_FORMAT_DEPTH16, colorWidth, colorHeight,
+                                             (int)depthInColor.getRowBytes(), (uint8_t*)depthInColor.getData(),
+                                             depthInColor.getRowBytes() * colorHeight, nullptr, nullptr,
+                                             &output) == K4A_RESULT_SUCCEEDED)
+            {
+                if (k4a_transformation_depth_image_to_color_camera(transformation, depth, output) ==
+                    K4A_RESULT_SUCCEEDED)
+                {
+                    result.depth = depthInColor;
+                }
+                k4a_image_release(output);
+            }
+
+            if (color == 0)
+                return;
+
+            const int stride = depthWidth * 4;
+            auto colorInDepth = registeredColorPool.acquire(stride * depthHeight);
+            if (k4a_image_create_from_buffer(K4A_IMAGE_FORMAT_COLOR_BGRA32, depthWidth, depthHeight, stride,
+                                             colorInDepth.get(), stride * depthHeight, nullptr, nullptr,
+                                             &output) == K4A_RESULT_SUCCEEDED)
+            {
+                if (k4a_transformation_color_image_to_depth_camera(transformation, depth, color, output) ==
+                    K4A_RESULT_SUCCEEDED)
+                {
+                    result.colorBuffer = colorInDepth;
+                    result.color =
+                        Surface8u(colorInDepth.get(), depthWidth, depthHeight, stride, SurfaceChannelOrder::BGRX);
+                }
+                k4a_image_release(output);
+            }
+        }
+
+        void updateBodies(BodyResult& result)
+        {
+            if (option.enableBody)
+            {
+                bodySlots.begin();
+                for (const auto& body : result.bodies)
+                {
+                    Body* slot = bodySlots.acquire(body.id);
+                    if (slot != nullptr)
+                        *slot = body;
+                }
+                bodySlots.end();
+                bodyTimestamp = result.timestamp;
+                signalBodyDirty.emit();
+            }
+            if (option.enableBodyIndex)
+            {
+                k4a_image_t image = k4abt_frame_get_body_index_map(result.frame.get());
+                if (image != 0)
+                {
+                    if (bodyIndexSize.x == 0 || bodyIndexSize.y == 0)
+                    {
+                        bodyIndexSize.x = k4a_image_get_width_pixels(image);
+                        bodyIndexSize.y = k4a_image_get_height_pixels(image);
+                        bodyIndexSize.z = k4a_image_get_stride_bytes(image);
+                    }
+                    auto ptr = (uint8_t*)k4a_image_get_buffer(image);
+                    if (ptr != nullptr)
+                    {
+                        bodyIndexChannel = Channel8u(bodyIndexSize.x, bodyIndexSize.y, bodyIndexSize.z, 1, ptr);
+                        // outlives the recycled BodyResult until the next index map replaces it
+                        bodyIndexFrame = result.frame;
+                        bodyTimestamp = result.timestamp;
+                        signalBodyIndexDirty.emit();
+                    }
+                    k4a_image_release(image);
+                }
+            }
         }
 
         k4a_device_t device_handle = 0;
         ivec3 colorSize, depthSize, bodyIndexSize;
         k4a_calibration_t calibration;
-        k4abt_tracker_t tracker;
+        k4abt_tracker_t tracker = nullptr;
+
+        DepthToColorMapper depthToColorMapper;
+        k4a_transformation_t transformation = nullptr;
+        WorkerPool registrationPool;
+        BufferPool<uint16_t> registeredDepthPool; // registration thread only
+        BufferPool<uint8_t> registeredColorPool;  // registration thread only
+        mutex registrationMutex;
+        shared_ptr<RegistrationResult> pendingRegistration;
+        shared_ptr<uint8_t> registeredColorBuffer; // update thread only
+
+        int colorScale = 1;
+        WorkerPool decodePool;
+        mutex colorPoolMutex;
+        BufferPool<uint8_t> colorPool; // shared by the workers, under colorPoolMutex
+
+        mutex colorMutex;
+        shared_ptr<ColorResult> pendingColor;
+        shared_ptr<ColorResult> frontColor; // update thread only
+        uint64_t colorTimestamp = 0;
+
+        atomic<bool> isRunning{false};
+        thread captureThread, trackerThread;
+
+        mutex captureMutex;
+        CaptureRef pendingCapture;
+        CaptureRef colorCapture, depthCapture, infraredCapture; // back the published images, update thread only
+
+        mutex bodyMutex;
+        shared_ptr<BodyResult> pendingBodies;
+        BodyFrameRef bodyIndexFrame; // backs bodyIndexChannel, update thread only
+        vector<shared_ptr<BodyResult>> bodyResults; // tracker thread only
+
+        static const uint32_t kMaxBodies = 16;
+        TrackedSlots<Body> bodySlots;
     };
 
     uint32_t getKinectAzureCount() { return k4a_device_get_installed_count(); }
@@ -7,6 +7,8 @@
 #include "cinder/Log.h"
 #include "cinder/app/app.h"
 
+#include <mutex>
+
 #pragma comment(lib, "OpenNI2.lib")
 
 using namespace ci;
@@ -15,11 +17,50 @@ using namespace std;
 
 namespace ds
 {
+    // Keeps the latest frame of one stream. OpenNI calls onNewFrame() from its own thread as soon as a frame is
+    // ready, the update thread picks it up whenever it runs; streams never wait for each other.
+    struct FrameSlot : public openni::VideoStream::NewFrameListener
+    {
+        void onNewFrame(openni::VideoStream& stream)
+        {
+            openni::VideoFrameRef frame;
+            if (stream.readFrame(&frame) != openni::STATUS_OK)
+            {
+                CI_LOG_E("Read failed!\n" << openni::OpenNI::getExtendedError());
+                return;
+            }
+
+            lock_guard<mutex> lock(mtx);
+            pending = frame;
+            isFresh = true;
+        }
+
+        // Moves the latest frame into front if a new one arrived since the last call
+        bool acquire()
+        {
+            lock_guard<mutex> lock(mtx);
+            if (!isFresh)
+                return false;
+
+            front = pending;
+            pending.release();
+            isFresh = false;
+            return true;
+        }
+
+        mutex mtx;
+        openni::VideoFrameRef pending;
+        bool isFresh = false;
+
+        openni::VideoFrameRef front; // backs the published channel / surface, update thread only
+    };
+
     struct DeviceOpenNI : public Device
     {
         static const int OpenNiSensorTypeCount = openni::SENSOR_DEPTH;
         openni::Device device;
         openni::VideoStream infraredStream, depthStream, colorStream;
+        FrameSlot infraredSlot, depthSlot, colorSlot;
 
         ivec2 depthSize;
         ivec2 colorSize;
@@ -32,6 +73,21 @@ namespace ds
 
         ~DeviceOpenNI()
         {
+            openni::VideoStream* streams[] = {&infraredStream, &colorStream, &depthStream};
+            FrameSlot* slots[] = {&infraredSlot, &colorSlot, &depthSlot};
+            for (int i = 0; i < OpenNiSensorTypeCount; i++)
+            {
+                if (!streams[i]->isValid())
+                    continue;
+
+                streams[i]->removeNewFrameListener(slots[i]);
+                streams[i]->stop();
+                // The held frames belong to the stream, give them back before it and OpenNI go away
+                slots[i]->front.release();
+                slots[i]->pending.release();
+                streams[i]->destroy();
+            }
+
             // TODO: ref-count
             openni::OpenNI::shutdown();
         }
@@ -69,6 +125,12 @@ namespace ds
                 &depthStream,
             };
 
+            FrameSlot* slots[] = {
+                &infraredSlot,
+                &colorSlot,
+                &depthSlot,
+            };
+
             for (int i = 0; i < OpenNiSensorTypeCount; i++)
             {
                 if (!streamEnabled[i])
@@ -86,6 +148,14 @@ namespace ds
                     }
                 }
 
+                rc = streams[i]->addNewFrameListener(slots[i]);
+                if (rc != openni::STATUS_OK)
+                {
+                    CI_LOG_E("Couldn't listen to stream " << i << "\n"
+                                                          << openni::OpenNI::getExtendedError());
+                    return;
+                }
+
                 rc = streams[i]->start();
                 if (rc != openni::STATUS_OK)
                 {
@@ -98,34 +168,11 @@ namespace ds
             App::get()->getSignalUpdate().connect(std::bind(&DeviceOpenNI::update, this));
         }
 
-        static const int SAMPLE_READ_WAIT_TIMEOUT = 100; // ms
-        openni::VideoFrameRef grabVideoFrame(openni::VideoStream* pStream)
-        {
-            openni::VideoFrameRef frame;
-
-            int changedStreamDummy;
-            openni::Status rc = openni::OpenNI::waitForAnyStream(&pStream, 1, &changedStreamDummy,
-                                                                 SAMPLE_READ_WAIT_TIMEOUT);
-            if (rc != openni::STATUS_OK)
-            {
-                CI_LOG_E("Wait timeout " << SAMPLE_READ_WAIT_TIMEOUT << " ms "
-                                         << openni::OpenNI::getExtendedError());
-            }
-
-            rc = pStream->readFrame(&frame);
-            if (rc != openni::STATUS_OK)
-            {
-                CI_LOG_E("Read failed!\n" << openni::OpenNI::getExtendedError());
-            }
-
-            return frame;
-        }
-
         void update()
         {
-            if (option.enableDepth)
+            if (option.enableDepth && depthSlot.acquire())
             {
-                auto frame = grabVideoFrame(&depthStream);
+                auto& frame = depthSlot.front;
                 depthSize.x = frame.getWidth();
                 depthSize.y = frame.getHeight();
                 auto data = (uint16_t*)frame.getData();
@@ -134,9 +181,9 @@ namespace ds
                 signalDepthDirty.emit();
             }
 
-            if (option.enableInfrared)
+            if (option.enableInfrared && infraredSlot.acquire())
             {
-                auto frame = grabVideoFrame(&infraredStream);
+                auto& frame = infraredSlot.front;
                 auto data = (uint16_t*)frame.getData();
                 int w = frame.getWidth();
                 int h = frame.getHeight();
@@ -144,9 +191,9 @@ namespace ds
                 signalInfraredDirty.emit();
             }
 
-            if (option.enableColor)
+            if (option.enableColor && colorSlot.acquire())
             {
-                auto frame = grabVideoFrame(&colorStream);
+                auto& frame = colorSlot.front;
                 auto data = (uint8_t*)frame.getData();
                 colorSize.x = frame.getWidth();
                 colorSize.y = frame.getHeight();
@@ -7,22 +7,94 @@
 #include "cinder/Log.h"
 #include "cinder/app/App.h"
 
+#include "BufferPool.h"
+#include "DepthKernels.h"
+
+#include <atomic>
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
 
 namespace ds
 {
+    // Per-stream handoff between librealsense's USB thread and the update thread. The callback parks the newest
+    // detached frame (releasing any older one nobody picked up), the update thread swaps it out; neither waits.
+    struct FrameMailbox : public rs_frame_callback
+    {
+        rs_device* device = nullptr;
+        std::atomic<rs_frame_ref*> pending;
+        rs_frame_ref* front = nullptr; // owned by the update thread, backs the published channel / surface
+
+        FrameMailbox() : pending(nullptr) {}
+
+        void on_frame(rs_device*, rs_frame_ref* frame) override
+        {
+            release(pending.exchange(frame));
+        }
+
+        // Lifetime is tied to DeviceRealSense, not to the callback registration
+        void release() override {}
+
+        // Returns the data of a frame newer than the last one acquired, or nullptr
+        const void* acquire()
+        {
+            auto frame = pending.exchange(nullptr);
+            if (frame == nullptr)
+                return nullptr;
+
+            release(front);
+            front = frame;
+
+            rs_error* e = nullptr;
+            auto data = rs_get_detached_frame_data(frame, &e);
+            if (e)
+            {
+                CI_LOG_E(rs_get_error_message(e));
+                rs_free_error(e);
+                return nullptr;
+            }
+            return data;
+        }
+
+        void release(rs_frame_ref* frame)
+        {
+            if (frame == nullptr)
+                return;
+
+            rs_error* e = nullptr;
+            rs_release_frame(device, frame, &e);
+            if (e)
+                rs_free_error(e);
+        }
+
+        void reset()
+        {
+            release(pending.exchange(nullptr));
+            release(front);
+            front = nullptr;
+        }
+    };
+
     struct DeviceRealSense : public Device
     {
+        // declared before ctx, so that they outlive the device which still references them as callbacks
+        FrameMailbox depthMailbox, colorMailbox, infraredMailbox;
+
         rs::context ctx;
         rs::device* dev = nullptr;
-        float depthScale;
+        float depthScale; // mm per raw depth unit
+
+        // depthChannel is converted to mm into pooled buffers, leaving the librealsense frame untouched
+        DepthRescaler depthRescaler;
+        BufferPool<uint16_t> depthPool;
 
         rs::intrinsics depth_intrin;
         rs::extrinsics depth_to_color;
         rs::intrinsics color_intrin;
 
+        DepthToColorMapper depthToColorMapper;
+
         ivec2 kDepthSize = {640, 480};
         ivec2 kColorSize = {640, 480};
 
@@ -32,9 +104,17 @@ namespace ds
             return 1;
         }
 
-        virtual float getDepthToMmScale() { return depthScale; }
+        ~DeviceRealSense()
+        {
+            if (dev == nullptr)
+                return;
 
-        ~DeviceRealSense() {}
+            if (dev->is_streaming())
+                dev->stop();
+            depthMailbox.reset();
+            colorMailbox.reset();
+            infraredMailbox.reset();
+        }
 
         // TODO:
         ivec2 getDepthSize() const { return kDepthSize; }
@@ -69,6 +149,7 @@ namespace ds
                 dev->enable_stream(rs::stream::depth, kDepthSize.x, kDepthSize.y, rs::format::z16,
                                    60);
                 depthScale = dev->get_depth_scale() * 1000;
+                depthRescaler.setup(depthScale, option.minDepth, option.maxDepth);
             }
 
             if (option.enablePointCloud && option.enableColor)
@@ -89,6 +170,10 @@ namespace ds
                                    rs::format::y16, 60);
             }
 
+            listen(rs::stream::depth, depthMailbox, option.enableDepth);
+            listen(rs::stream::color, colorMailbox, option.enableColor);
+            listen(rs::stream::infrared, infraredMailbox, option.enableInfrared);
+
             dev->start();
 
             if (option.enableDepth)
@@ -106,60 +191,70 @@ namespace ds
                 color_intrin = dev->get_stream_intrinsics(rs::stream::color);
             }
 
+            if (option.enablePointCloud && option.enableColor)
+            {
+                setupDepthToColorMapper();
+            }
+
             App::get()->getSignalUpdate().connect(std::bind(&DeviceRealSense::update, this));
         }
 
+        // Calibration is fixed while streaming, so everything but the depth value is folded into per-pixel tables
+        void setupDepthToColorMapper()
+        {
+            vector<float> rays(depth_intrin.width * depth_intrin.height * 2);
+            for (int y = 0; y < depth_intrin.height; y++)
+                for (int x = 0; x < depth_intrin.width; x++)
+                {
+                    rs::float3 ray = depth_intrin.deproject({(float)x, (float)y}, 1);
+                    rays[(y * depth_intrin.width + x) * 2 + 0] = ray.x;
+                    rays[(y * depth_intrin.width + x) * 2 + 1] = ray.y;
+                }
+
+            PinholeIntrinsics color;
+            color.width = color_intrin.width;
+            color.height = color_intrin.height;
+            color.ppx = color_intrin.ppx;
+            color.ppy = color_intrin.ppy;
+            color.fx = color_intrin.fx;
+            color.fy = color_intrin.fy;
+            if (color_intrin.model() == rs::distortion::modified_brown_conrady)
+                color.model = PinholeIntrinsics::MODIFIED_BROWN_CONRADY;
+            for (int i = 0; i < 5; i++)
+                color.coeffs[i] = color_intrin.coeffs[i];
+
+            depthToColorMapper.setup(depth_intrin.width, depth_intrin.height, rays.data(),
+                                     depth_to_color.rotation, depth_to_color.translation,
+                                     dev->get_depth_scale(), color);
+        }
+
+        void listen(rs::stream stream, FrameMailbox& mailbox, bool enabled)
+        {
+            if (!enabled)
+                return;
+
+            mailbox.device = (rs_device*)dev;
+            rs_error* e = nullptr;
+            rs_set_frame_callback_cpp((rs_device*)dev, (rs_stream)stream, &mailbox, &e);
+            rs::error::handle(e);
+        }
+
         void update()
         {
-            dev->wait_for_frames();
+            if (!isValid())
+                return;
 
-            if (option.enableDepth)
+            // Streams are independent: each one publishes whenever its own mailbox has something new
+            auto depth_image = option.enableDepth ? (const uint16_t*)depthMailbox.acquire() : nullptr;
+            if (depth_image)
             {
-                auto depth_image = (uint16_t*)dev->get_frame_data(rs::stream::depth);
-                for (int i = 0; i < kDepthSize.x * kDepthSize.y; i++)
-                {
-                    depth_image[i] = depth_image[i] * 0.1f;
-                }
-                depthChannel = Channel16u(kDepthSize.x, kDepthSize.y,
-                                          sizeof(uint16_t) * kDepthSize.x, 1, depth_image);
+                depthChannel = depthPool.acquireChannel(kDepthSize.x, kDepthSize.y);
+                depthRescaler.process(depthChannel.getData(), depth_image, kDepthSize.x * kDepthSize.y);
                 signalDepthDirty.emit();
 
-                if (option.enablePointCloud)
+                if (option.enablePointCloud && option.enableColor)
                 {
-                    auto depthToMeter = dev->get_depth_scale();
-
-                    vec3* dst = (vec3*)depthToColorTable.getData();
-                    for (int dy = 0; dy < depth_intrin.height; ++dy)
-                    {
-                        for (int dx = 0; dx < depth_intrin.width; ++dx)
-                        {
-                            // Retrieve the 16-bit depth value and map it into a depth in meters
-                            uint16_t depth_value = depth_image[dy * depth_intrin.width + dx];
-                            if (depth_value == 0)
-                            {
-                                dst->x = 0;
-                                dst->y = 0;
-                            }
-                            else
-                            {
-                                float depth_in_meters = depth_value * depthToMeter;
-
-                                // Map from pixel coordinates in the depth image to pixel
-                                // coordinates in the color image
-                                rs::float2 depth_pixel = {(float)dx, (float)dy};
-                                rs::float3 depth_point =
-                                    depth_intrin.deproject(depth_pixel, depth_in_meters);
-                                rs::float3 color_point = depth_to_color.transform(depth_point);
-                                rs::float2 color_texcoord =
-                                    color_intrin.project_to_texcoord(color_point);
-
-                                dst->x = color_texcoord.x;
-                                dst->y = color_texcoord.y;
-                            }
-
-                            dst++;
-                        }
-                    }
+                    depthToColorMapper.process(depthToColorTable.getData(), depth_image);
                     signalDepthToColorTableDirty.emit();
                 }
 
@@ -184,19 +279,19 @@ namespace ds
                 }
             }
 
-            if (option.enableInfrared)
+            auto infrared_image = option.enableInfrared ? (uint16_t*)infraredMailbox.acquire() : nullptr;
+            if (infrared_image)
             {
-                auto data = (uint16_t*)dev->get_frame_data(rs::stream::infrared);
                 infraredChannel = Channel16u(kDepthSize.x, kDepthSize.y,
-                                             sizeof(uint16_t) * kDepthSize.x, 1, data);
+                                             sizeof(uint16_t) * kDepthSize.x, 1, infrared_image);
                 signalInfraredDirty.emit();
             }
 
-            if (option.enableColor)
+            auto color_image = option.enableColor ? (uint8_t*)colorMailbox.acquire() : nullptr;
+            if (color_image)
             {
-                uint8_t* data = (uint8_t*)dev->get_frame_data(rs::stream::color);
                 colorSurface =
-                    Surface8u(data, kDepthSize.x, kDepthSize.y, sizeof(uint8_t) * 3 * kColorSize.x,
+                    Surface8u(color_image, kColorSize.x, kColorSize.y, sizeof(uint8_t) * 3 * kColorSize.x,
                               SurfaceChannelOrder::RGB);
                 signalColorDirty.emit();
             }
@@ -6,42 +6,150 @@
 #include "cinder/Log.h"
 #include "cinder/app/App.h"
 
+#include "ColorKernels.h"
+
+#include <atomic>
+#include <mutex>
+
+#if defined(CINDER_MSW_DESKTOP)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#if WINVER >= 0x0602
+#include <cfgmgr32.h>
+#pragma comment(lib, "cfgmgr32")
+#define DS_CM_NOTIFICATIONS
+#endif
+#elif defined(CINDER_MAC)
+#include <IOKit/IOKitLib.h>
+#endif
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
 
 namespace ds
 {
+    // Capture::getDevices() only rescans the hardware when forced to, so a camera plugged in later never showed up.
+    // Rescan once, then again only after the OS reports a device coming or going.
+    struct CaptureDevices
+    {
+        static const vector<Capture::DeviceRef>& get()
+        {
+            static CaptureDevices instance;
+
+            lock_guard<mutex> lock(instance.scanMutex);
+            return Capture::getDevices(instance.isStale.exchange(false));
+        }
+
+      private:
+        CaptureDevices()
+        {
+            if (!watch())
+                CI_LOG_W("No camera hotplug notifications, the camera list is scanned once");
+        }
+
+#if defined(DS_CM_NOTIFICATIONS)
+        static DWORD CALLBACK onChange(HCMNOTIFICATION, PVOID context, CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA,
+                                       DWORD)
+        {
+            if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+                ((CaptureDevices*)context)->isStale = true;
+            return ERROR_SUCCESS;
+        }
+
+        bool watch()
+        {
+            // KSCATEGORY_CAPTURE, the interface class DirectShow video inputs are listed under
+            const GUID kCaptureCategory = {0x65E8773D, 0x8F56, 0x11D0, {0xA3, 0xB9, 0x00, 0xA0, 0xC9, 0x22, 0x31, 0x96}};
+
+            CM_NOTIFY_FILTER filter = {};
+            filter.cbSize = sizeof(filter);
+            filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+            filter.u.DeviceInterface.ClassGuid = kCaptureCategory;
+            HCMNOTIFICATION notification;
+            return CM_Register_Notification(&filter, this, &CaptureDevices::onChange, &notification) == CR_SUCCESS;
+        }
+#elif defined(CINDER_MAC)
+        static void onChange(void* context, io_iterator_t iterator)
+        {
+            // the iterator has to be drained to re-arm the notification
+            while (io_object_t device = IOIteratorNext(iterator))
+                IOObjectRelease(device);
+            ((CaptureDevices*)context)->isStale = true;
+        }
+
+        bool watch()
+        {
+            IONotificationPortRef port = IONotificationPortCreate(kIOMasterPortDefault);
+            if (!port)
+                return false;
+            CFRunLoopAddSource(CFRunLoopGetMain(), IONotificationPortGetRunLoopSource(port), kCFRunLoopDefaultMode);
+
+            const char* types[] = {kIOFirstMatchNotification, kIOTerminatedNotification};
+            for (auto type : types)
+            {
+                // any USB device, webcams don't have a class of their own at this level
+                io_iterator_t iterator;
+                if (IOServiceAddMatchingNotification(port, type, IOServiceMatching("IOUSBHostDevice"),
+                                                     &CaptureDevices::onChange, this, &iterator) != KERN_SUCCESS)
+                    return false;
+                onChange(this, iterator);
+            }
+            return true;
+        }
+#else
+        bool watch() { return false; }
+#endif
+
+        mutex scanMutex;
+        atomic<bool> isStale{true};
+    };
+
     struct DeviceRgbCamera : public Device
     {
         CaptureRef mCapture;
+        Surface8uRef mFrame; // colorSurface points into it
 
         virtual bool isValid() const { return mCapture != nullptr; }
 
-        const int32_t kWidth = 640;
-        const int32_t kHeight = 480;
+        ivec2 size = {640, 480};
 
-        ivec2 getDepthSize() const { return {kWidth, kHeight}; }
+        ivec2 getDepthSize() const { return size; }
 
-        ivec2 getColorSize() const { return {kWidth, kHeight}; }
+        ivec2 getColorSize() const { return size; }
 
         DeviceRgbCamera(Option option)
         {
             this->option = option;
+            if (option.colorWidth > 0 && option.colorHeight > 0)
+                size = {option.colorWidth, option.colorHeight};
+
+            const auto& devices = CaptureDevices::get();
+            if (option.deviceId < 0 || (size_t)option.deviceId >= devices.size())
+            {
+                CI_LOG_E("There is no camera #" << option.deviceId);
+                return;
+            }
 
             try
             {
-                mCapture = Capture::create(kWidth, kHeight, Capture::getDevices()[option.deviceId]);
+                mCapture = Capture::create(size.x, size.y, devices[option.deviceId]);
                 mCapture->start();
+                // the driver may settle on another size
+                size = {mCapture->getWidth(), mCapture->getHeight()};
             }
             catch (ci::Exception& exc)
             {
                 CI_LOG_EXCEPTION("Failed to init capture ", exc);
+                mCapture.reset();
+                return;
             }
 
             if (option.enableDepth)
             {
-                depthChannel = Channel16u(kWidth, kHeight);
+                depthChannel = Channel16u(size.x, size.y);
             }
 
             App::get()->getSignalUpdate().connect(std::bind(&DeviceRgbCamera::update, this));
@@ -54,55 +162,57 @@ namespace ds
 
             if (mCapture->checkNewFrame())
             {
+                // Capture has no frame rate control, so with option.fps set frames beyond it are skipped here
+                double now = getElapsedSeconds();
+                if (option.fps > 0 && now - lastFrameTime < 0.9 / option.fps)
+                    return;
+                lastFrameTime = now;
+
                 if (option.enablePointCloud && option.enableColor &&
                     depthToColorTable.getWidth() == 0)
                 {
                     depthToColorTable =
-                        Surface32f(kWidth, kHeight, false, SurfaceChannelOrder::RGB);
+                        Surface32f(size.x, size.y, false, SurfaceChannelOrder::RGB);
 
-                    for (int y = 0; y < kHeight; y++)
+                    for (int y = 0; y < size.y; y++)
                     {
-                        for (int x = 0; x < kWidth; x++)
+                        for (int x = 0; x < size.x; x++)
                         {
                             float* data = depthToColorTable.getData({x, y});
-                            data[0] = x / (float)kWidth;
-                            data[1] = y / (float)kHeight;
+                            data[0] = x / (float)size.x;
+                            data[1] = y / (float)size.y;
                         }
                     }
                     signalDepthToColorTableDirty.emit();
                 }
 
-                colorSurface = *mCapture->getSurface();
+                // Copying a Surface8u copies its pixels, refer to the capture's instead
+                mFrame = mCapture->getSurface();
+                if (!mFrame)
+                    return;
+                colorSurface = Surface8u(mFrame->getData(), mFrame->getWidth(), mFrame->getHeight(),
+                                         mFrame->getRowBytes(), mFrame->getChannelOrder());
                 if (option.enableColor)
                 {
                     signalColorDirty.emit();
                 }
                 if (option.enableDepth)
                 {
-#if 0
-                    cv::Mat im = toOcv(colorSurface);
-                    cv::cvtColor(im, im, cv::COLOR_BGR2GRAY);  // 3 to 1 chan
-                    im.convertTo(im, CV_16U, 255); // 8bit to 16
-                    depthChannel = fromOcv(im);
-#else
-                    for (int x = 0; x < kWidth; x++)
-                        for (int y = 0; y < kHeight; y++)
-                        {
-                            uint16_t* dest = depthChannel.getData({x, y});
-                            uint8_t* src = colorSurface.getData({x, y});
-                            *dest = (src[0] + src[1] + src[2]) * 4; // 4 is magic number
-                        }
-#endif
-
+                    const int channelOffsets[] = {mFrame->getRedOffset(), mFrame->getGreenOffset(),
+                                                  mFrame->getBlueOffset()};
+                    convertToLuma16(depthChannel.getData(), depthChannel.getRowBytes(), mFrame->getData(),
+                                    mFrame->getRowBytes(), min(size.x, mFrame->getWidth()),
+                                    min(size.y, mFrame->getHeight()), mFrame->getPixelInc(), channelOffsets,
+                                    &option.lumaWeights[0], option.lumaGain);
                     signalDepthDirty.emit();
                 }
             }
         }
 
-        int width, height;
+        double lastFrameTime = 0;
     };
 
-    uint32_t getRgbCameraCount() { return Capture::getDevices().size(); }
+    uint32_t getRgbCameraCount() { return CaptureDevices::get().size(); }
 
     DeviceRef createRgbCamera(Option option) { return DeviceRef(new DeviceRgbCamera(option)); }
 } // namespace ds
@@ -0,0 +1,266 @@
+#include "DepthSensor.h"
+
+#ifdef SharedMemory_Enabled
+
+#include "cinder/Log.h"
+#include "cinder/app/App.h"
+
+#include "SharedFrames.h"
+
+#include <cstring>
+#include <memory>
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+namespace ds
+{
+    using namespace SharedFrames;
+
+    // Maps the shared memory of a FrameServer read-only and publishes its frames without copying them: channels and
+    // surfaces point into the ring, are read-only, and stay valid until the server wraps around to their slot, which
+    // isFrameIntact() tells.
+    struct DeviceSharedMemory : public Device
+    {
+        struct Stream
+        {
+            unique_ptr<SharedMapping> memory;
+            unique_ptr<SharedMapping> published; // the previous mapping, until memory has a frame published
+            uint64_t serverId = 0, generation = 0;
+            Slot* publishedSlot = nullptr; // of the published image, in memory or published
+            uint64_t publishedSequence = 0;
+            uint64_t lastFrame = 0;
+            double lastFrameSeconds = 0;
+            double lastOpenSeconds = -1e9;
+        };
+
+        Stream streams[STREAM_COUNT];
+        bool isStreamEnabled[STREAM_COUNT] = {};
+        ivec2 depthSize, colorSize;
+        uint64_t overwrittenCount = 0;
+        vector<Body> scratchBodies; // bodies are read here and swapped in once the copy is known to be whole
+
+        virtual bool isValid() const
+        {
+            for (int s = 0; s < STREAM_COUNT; s++)
+                if (streams[s].memory)
+                    return true;
+            return false;
+        }
+
+        ivec2 getDepthSize() const { return depthSize; }
+
+        ivec2 getColorSize() const { return colorSize; }
+
+        float getDepthToMmScale() { return depthToMmScale; }
+
+        float depthToMmScale = 1.0f;
+
+        bool isFrameIntact(const void* data) const
+        {
+            for (const Stream& stream : streams)
+            {
+                if (stream.publishedSlot == nullptr || getSlotData(stream.publishedSlot) != data)
+                    continue;
+                atomic_thread_fence(memory_order_acquire);
+                return stream.publishedSlot->sequence.load(memory_order_relaxed) == stream.publishedSequence;
+            }
+            return true;
+        }
+
+        DeviceSharedMemory(Option option)
+        {
+            this->option = option;
+            isStreamEnabled[DEPTH] = option.enableDepth;
+            isStreamEnabled[INFRARED] = option.enableInfrared;
+            isStreamEnabled[BODY_INDEX] = option.enableBodyIndex;
+            isStreamEnabled[COLOR] = option.enableColor;
+            isStreamEnabled[BODY] = option.enableBody;
+            isStreamEnabled[DEPTH_TO_CAMERA_TABLE] = option.enablePointCloud;
+            isStreamEnabled[DEPTH_TO_COLOR_TABLE] = option.enablePointCloud && option.enableColor;
+            bodies.reserve(kMaxBodies);
+            scratchBodies.reserve(kMaxBodies);
+
+            const double now = getElapsedSeconds();
+            for (int s = 0; s < STREAM_COUNT; s++)
+                if (isStreamEnabled[s])
+                    open((SharedFrames::Stream)s, now);
+            if (!isValid())
+                CI_LOG_W("No FrameServer named " << option.sharedMemoryName << " is running yet, waiting for it");
+
+            App::get()->getSignalUpdate().connect(std::bind(&DeviceSharedMemory::update, this));
+        }
+
+        // Maps stream unless it is the one already mapped, keeps the current mapping when there is nothing better
+        void open(SharedFrames::Stream s, double now)
+        {
+            Stream& stream = streams[s];
+            stream.lastOpenSeconds = now;
+
+            SharedMapping directory;
+            if (!directory.open(getObjectName(option.sharedMemoryName, s)) || directory.getSize() < kDirectoryBytes)
+                return;
+            const Directory* entry = getDirectory(directory);
+            if (entry->magic != kMagic || entry->version != kVersion)
+            {
+                CI_LOG_E(getObjectName(option.sharedMemoryName, s) << " was published by an incompatible FrameServer");
+                return;
+            }
+            const uint64_t generation = entry->generation.load(memory_order_acquire);
+            if (generation == 0)
+                return;
+
+            unique_ptr<SharedMapping> memory(new SharedMapping);
+            const string name = getObjectName(option.sharedMemoryName, s, generation);
+            if (!memory->open(name) || memory->getSize() < kHeaderBytes)
+                return;
+            const Header* header = getHeader(*memory);
+            if (header->magic != kMagic || header->version != kVersion || header->bodyBytes != sizeof(Body) ||
+                header->slotCount == 0 || memory->getSize() < kHeaderBytes + header->slotCount * header->slotBytes)
+            {
+                CI_LOG_E(name << " was published by an incompatible FrameServer");
+                return;
+            }
+            if (header->isClosed.load(memory_order_acquire) ||
+                (stream.memory && header->serverId == stream.serverId && header->generation == stream.generation))
+                return;
+
+            // The published channels and surfaces still point into the old mapping
+            if (stream.lastFrame != 0)
+                stream.published = move(stream.memory);
+            stream.memory = move(memory);
+            stream.serverId = header->serverId;
+            stream.generation = header->generation;
+            stream.lastFrame = 0;
+            stream.lastFrameSeconds = now;
+            depthToMmScale = header->depthToMmScale;
+            focalLength = vec2(header->focalLength[0], header->focalLength[1]);
+        }
+
+        void update()
+        {
+            const double now = getElapsedSeconds();
+
+            // Tables first, so a point cloud built on signalDepthDirty finds them
+            static const SharedFrames::Stream order[] = {DEPTH_TO_CAMERA_TABLE, DEPTH_TO_COLOR_TABLE, DEPTH, INFRARED,
+                                                         BODY_INDEX, COLOR, BODY};
+            for (auto s : order)
+            {
+                if (!isStreamEnabled[s])
+                    continue;
+                Stream& stream = streams[s];
+
+                // Reopen once a second when the server is gone, restarted, resized (a new object named by the
+                // directory) or quiet, keeping the frames published so far until a new server shows up
+                const bool isClosed = stream.memory && getHeader(*stream.memory)->isClosed.load(memory_order_acquire);
+                if ((!stream.memory || isClosed || now - stream.lastFrameSeconds > 2) &&
+                    now - stream.lastOpenSeconds > 1)
+                    open(s, now);
+                if (!stream.memory)
+                    continue;
+
+                const SharedMapping& memory = *stream.memory;
+                const Header* header = getHeader(memory);
+                const uint64_t frame = header->latest.load(memory_order_acquire);
+                if (frame == stream.lastFrame)
+                    continue;
+                Slot* slot = getSlot(memory, frame);
+                const uint64_t sequence = slot->sequence.load(memory_order_acquire);
+                if (sequence != frame * 2)
+                    continue; // already being overwritten, take the next one
+                stream.lastFrame = frame;
+                stream.lastFrameSeconds = now;
+
+                if (s == BODY)
+                    readBodies(slot, sequence);
+                else if (!readImage(s, header, slot, sequence))
+                    continue;
+                stream.published.reset();
+
+                atomic_thread_fence(memory_order_acquire);
+                if (slot->sequence.load(memory_order_relaxed) != sequence && overwrittenCount++ == 0)
+                    CI_LOG_W("A frame was overwritten while in use, raise FrameServer::Options::slotCount");
+            }
+        }
+
+        // Returns false when slot holds no usable image, leaving the published one alone
+        bool readImage(SharedFrames::Stream s, const Header* header, Slot* slot, uint64_t sequence)
+        {
+            const int32_t width = slot->width, height = slot->height, rowBytes = slot->rowBytes;
+            if (width <= 0 || height <= 0 || rowBytes <= 0 ||
+                kSlotHeaderBytes + (uint64_t)rowBytes * height > header->slotBytes)
+                return false;
+            // Before the signal, so its slots can call isFrameIntact()
+            streams[s].publishedSlot = slot;
+            streams[s].publishedSequence = sequence;
+            uint8_t* data = getSlotData(slot);
+            const SurfaceChannelOrder channelOrder(slot->channelOrder);
+
+            switch (s)
+            {
+            case DEPTH:
+                depthChannel = Channel16u(width, height, rowBytes, 1, (uint16_t*)data);
+                depthSize = ivec2(width, height);
+                signalDepthDirty.emit();
+                break;
+            case INFRARED:
+                infraredChannel = Channel16u(width, height, rowBytes, 1, (uint16_t*)data);
+                signalInfraredDirty.emit();
+                break;
+            case BODY_INDEX:
+                bodyIndexChannel = Channel8u(width, height, rowBytes, 1, data);
+                bodyTimestamp = slot->timestamp;
+                signalBodyIndexDirty.emit();
+                break;
+            case COLOR:
+                colorSurface = Surface8u(data, width, height, rowBytes, channelOrder);
+                colorSize = ivec2(width, height);
+                signalColorDirty.emit();
+                break;
+            case DEPTH_TO_CAMERA_TABLE:
+                depthToCameraTable = Surface32f((float*)data, width, height, rowBytes, channelOrder);
+                signalDepthToCameraTableDirty.emit();
+                break;
+            case DEPTH_TO_COLOR_TABLE:
+                depthToColorTable = Surface32f((float*)data, width, height, rowBytes, channelOrder);
+                signalDepthToColorTableDirty.emit();
+                break;
+            default:
+                return false;
+            }
+            return true;
+        }
+
+        // Bodies are copied, and dropped if the copy raced with the server, leaving the published ones untouched
+        void readBodies(Slot* slot, uint64_t sequence)
+        {
+            const size_t count = min<size_t>(slot->count, kMaxBodies);
+            scratchBodies.resize(count);
+            memcpy(scratchBodies.data(), getSlotData(slot), count * sizeof(Body));
+            const uint64_t timestamp = slot->timestamp;
+            atomic_thread_fence(memory_order_acquire);
+            if (slot->sequence.load(memory_order_relaxed) != sequence)
+                return;
+            bodies.swap(scratchBodies);
+            bodyTimestamp = timestamp;
+            signalBodyDirty.emit();
+        }
+    };
+
+    uint32_t getSharedMemoryCount()
+    {
+        const Option option;
+        for (int s = 0; s < STREAM_COUNT; s++)
+        {
+            SharedMapping memory;
+            if (memory.open(getObjectName(option.sharedMemoryName, (SharedFrames::Stream)s)))
+                return 1;
+        }
+        return 0;
+    }
+
+    DeviceRef createSharedMemory(Option option) { return DeviceRef(new DeviceSharedMemory(option)); }
+} // namespace ds
+
+#endif
@@ -2,10 +2,17 @@
 
 #ifdef Simulator_Enabled
 
+#include "BufferPool.h"
+#include "SimulatedScene.h"
+#include "WorkerPool.h"
 #include "cinder/ImageIo.h"
 #include "cinder/Log.h"
 #include "cinder/app/App.h"
 
+#include <algorithm>
+#include <cctype>
+#include <map>
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
@@ -14,30 +21,346 @@ namespace ds
 {
     struct DeviceSimulator : public Device
     {
-        virtual bool isValid() const { return true; }
+        virtual bool isValid() const { return option.simulatorSequence.empty() || !sequence.empty(); }
 
-        ivec2 getDepthSize() const { return depthChannel.getSize(); }
+        ivec2 getDepthSize() const
+        {
+            if (scene)
+                return {scene->camera.width, scene->camera.height};
+            if (!sequence.empty())
+                return sequenceDepthSize;
+            return depthChannel.getSize();
+        }
 
-        ivec2 getColorSize() const { return depthChannel.getSize(); }
+        ivec2 getColorSize() const
+        {
+            if (!sequence.empty())
+                return sequenceColorSize;
+            return getDepthSize();
+        }
 
         DeviceSimulator(Option option)
         {
             this->option = option;
-            depthChannel = loadImage(getAssetPath("KinectSnapshot-update.png"));
+            scene = option.simulatorScene;
+            if (!scene && option.simulatorBodyCount > 0)
+                scene = SimulatedScene::createCrowd(option.simulatorBodyCount, option.simulatorSeed);
+            if (scene)
+                setupPointCloud();
+            else if (!option.simulatorSequence.empty())
+                setupSequence();
+            else
+                depthChannel = loadImage(getAssetPath("KinectSnapshot-update.png"));
 
             App::get()->getSignalUpdate().connect(std::bind(&DeviceSimulator::update, this));
         }
 
+        ~DeviceSimulator() { decodePool.stop(); }
+
+        // Every stream shares the scene camera, so color registration is the identity
+        void setupPointCloud()
+        {
+            if (!option.enablePointCloud)
+                return;
+
+            const auto& camera = scene->camera;
+            depthToCameraTable = Surface32f(camera.width, camera.height, false, SurfaceChannelOrder::RGB);
+            depthToColorTable = Surface32f(camera.width, camera.height, false, SurfaceChannelOrder::RGB);
+            for (int y = 0; y < camera.height; y++)
+                for (int x = 0; x < camera.width; x++)
+                {
+                    vec2 ray = camera.getRay(x, y);
+                    float* dst = depthToCameraTable.getData({x, y});
+                    dst[0] = ray.x;
+                    dst[1] = ray.y;
+                    dst = depthToColorTable.getData({x, y});
+                    dst[0] = (x + 0.5f) / camera.width;
+                    dst[1] = (y + 0.5f) / camera.height;
+                }
+            signalDepthToCameraTableDirty.emit();
+            signalDepthToColorTableDirty.emit();
+        }
+
+        void setupSequence()
+        {
+            const auto& dir = option.simulatorSequence;
+            if (!fs::is_directory(dir))
+            {
+                CI_LOG_E("Simulator sequence " << dir << " is not a directory");
+                return;
+            }
+
+            map<uint64_t, SequenceFrame> frames;
+            for (fs::directory_iterator it(dir), end; it != end; ++it)
+            {
+                const auto& path = it->path();
+                string ext = path.extension().string(), stem = path.stem().string();
+                transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+                transform(stem.begin(), stem.end(), stem.begin(), ::tolower);
+                size_t digits = stem.find_last_not_of("0123456789") + 1;
+                if (ext != ".png" || digits == stem.size())
+                    continue;
+
+                uint64_t number = stoull(stem.substr(digits));
+                if (stem.find("depth") != string::npos)
+                    frames[number].depthPath = path;
+                else if (stem.find("color") != string::npos)
+                    frames[number].colorPath = path;
+            }
+            for (auto& frame : frames)
+                sequence.push_back(frame.second);
+            if (sequence.empty())
+            {
+                CI_LOG_E("No depth*.png or color*.png frames in " << dir);
+                return;
+            }
+
+            // Image headers are enough for the sizes, pixels are decoded ahead on the workers
+            for (auto& frame : sequence)
+            {
+                try
+                {
+                    if (sequenceDepthSize.x == 0 && !frame.depthPath.empty())
+                    {
+                        auto source = loadImage(frame.depthPath);
+                        sequenceDepthSize = {source->getWidth(), source->getHeight()};
+                    }
+                    if (sequenceColorSize.x == 0 && !frame.colorPath.empty())
+                    {
+                        auto source = loadImage(frame.colorPath);
+                        sequenceColorSize = {source->getWidth(), source->getHeight()};
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    CI_LOG_W("Failed to read a sequence frame: " << e.what());
+                }
+                if (sequenceDepthSize.x > 0 && sequenceColorSize.x > 0)
+                    break;
+            }
+
+            CI_LOG_I("Simulator replays " << sequence.size() << " frames from " << dir);
+            decodePool.start(max(1u, min(4u, thread::hardware_concurrency())));
+        }
+
+        // Keeps the slots of the next kRingSize frames assigned and their decodes queued
+        void prefetch(uint64_t frameIndex)
+        {
+            vector<uint64_t> queued;
+            {
+                lock_guard<mutex> lock(ringMutex);
+                for (uint64_t index = frameIndex; index < frameIndex + kRingSize; index++)
+                {
+                    Slot& slot = ring[index % kRingSize];
+                    if (slot.frameIndex == index)
+                        continue;
+                    const auto& frame = sequence[index % sequence.size()];
+                    slot.frameIndex = index;
+                    slot.depth.reset();
+                    slot.color.reset();
+                    slot.pending = 0;
+                    if (option.enableDepth && !frame.depthPath.empty())
+                        slot.pending++;
+                    if (option.enableColor && !frame.colorPath.empty())
+                        slot.pending++;
+                    queued.push_back(index);
+                }
+            }
+
+            // Depth and color decode as separate jobs so that both streams of a frame are worked on at once
+            for (uint64_t index : queued)
+            {
+                const auto& frame = sequence[index % sequence.size()];
+                if (option.enableDepth && !frame.depthPath.empty())
+                    decodePool.run([this, index] { decodeFrame(index, true); });
+                if (option.enableColor && !frame.colorPath.empty())
+                    decodePool.run([this, index] { decodeFrame(index, false); });
+            }
+        }
+
+        void decodeFrame(uint64_t index, bool isDepth)
+        {
+            Slot& slot = ring[index % kRingSize];
+            {
+                // playback may have moved past this frame while it was queued
+                lock_guard<mutex> lock(ringMutex);
+                if (slot.frameIndex != index)
+                    return;
+            }
+
+            const auto& frame = sequence[index % sequence.size()];
+            Channel16uRef depth;
+            Surface8uRef color;
+            try
+            {
+                if (isDepth)
+                    depth = Channel16u::create(loadImage(frame.depthPath));
+                else
+                    color = Surface8u::create(loadImage(frame.colorPath));
+            }
+            catch (const std::exception& e)
+            {
+                CI_LOG_W("Failed to decode " << (isDepth ? frame.depthPath : frame.colorPath) << ": " << e.what());
+            }
+
+            lock_guard<mutex> lock(ringMutex);
+            if (slot.frameIndex != index)
+                return;
+            if (isDepth)
+                slot.depth = depth;
+            else
+                slot.color = color;
+            slot.pending--;
+        }
+
+        void updateSequence()
+        {
+            // Frames are numbered on the app clock, a frame that is still decoding is skipped rather than waited for
+            const double fps = option.fps > 0 ? option.fps : 30;
+            const uint64_t frameIndex = (uint64_t)(getElapsedSeconds() * fps);
+            if (frameIndex == lastFrameIndex)
+                return;
+            prefetch(frameIndex);
+
+            Channel16uRef depth;
+            Surface8uRef color;
+            {
+                lock_guard<mutex> lock(ringMutex);
+                Slot& slot = ring[frameIndex % kRingSize];
+                if (slot.pending > 0)
+                    return;
+                depth = slot.depth;
+                color = slot.color;
+            }
+            lastFrameIndex = frameIndex;
+
+            if (depth)
+            {
+                // share the decoded pixels instead of copying them into depthChannel
+                depthChannel = Channel16u(depth->getWidth(), depth->getHeight(), depth->getRowBytes(), 1,
+                                          depth->getData(), shared_ptr<uint16_t>(depth, depth->getData()));
+                signalDepthDirty.emit();
+            }
+            if (color)
+            {
+                colorFrame = color;
+                colorSurface = Surface8u(color->getData(), color->getWidth(), color->getHeight(),
+                                         color->getRowBytes(), color->getChannelOrder());
+                signalColorDirty.emit();
+            }
+        }
+
         void update()
         {
+            if (!sequence.empty())
+            {
+                updateSequence();
+                return;
+            }
+
+            if (!scene)
+            {
+                if (option.enableDepth)
+                {
+                    // TODO: update depthChannel
+                    signalDepthDirty.emit();
+                }
+                return;
+            }
+
+            // Frames are numbered on the app clock so that a slow app drops frames rather than slowing the scene
+            const double fps = option.fps > 0 ? option.fps : 30;
+            const uint64_t frameIndex = (uint64_t)(getElapsedSeconds() * fps);
+            if (frameIndex == lastFrameIndex)
+                return;
+            lastFrameIndex = frameIndex;
+            scene->update(frameIndex / fps);
+
+            const int width = scene->camera.width, height = scene->camera.height;
+            SimulatedScene::Frame frame;
+            Channel16u depth, infrared;
+            Channel8u bodyIndex;
+            shared_ptr<uint8_t> color;
+            if (option.enableDepth)
+            {
+                depth = depthPool.acquireChannel(width, height);
+                frame.depth = depth.getData();
+            }
+            if (option.enableInfrared)
+            {
+                infrared = infraredPool.acquireChannel(width, height);
+                frame.infrared = infrared.getData();
+            }
+            if (option.enableBodyIndex)
+            {
+                bodyIndex = bodyIndexPool.acquireChannel(width, height);
+                frame.bodyIndex = bodyIndex.getData();
+            }
+            if (option.enableColor)
+            {
+                color = colorPool.acquire(width * height * 4);
+                frame.color = color.get();
+            }
+            scene->render(frame, frameIndex);
+
             if (option.enableDepth)
             {
-                // TODO: update depthChannel
+                depthChannel = depth;
                 signalDepthDirty.emit();
             }
+            if (option.enableInfrared)
+            {
+                infraredChannel = infrared;
+                signalInfraredDirty.emit();
+            }
+            if (option.enableColor)
+            {
+                // Surface8u can't share ownership, keep the buffer until the next one replaces it
+                colorBuffer = color;
+                colorSurface = Surface8u(color.get(), width, height, width * 4, SurfaceChannelOrder::BGRX);
+                signalColorDirty.emit();
+            }
+            if (option.enableBodyIndex)
+            {
+                bodyIndexChannel = bodyIndex;
+                signalBodyIndexDirty.emit();
+            }
+            if (option.enableBody)
+            {
+                bodies = scene->bodies;
+                bodyTimestamp = (uint64_t)(frameIndex * 1e6 / fps);
+                signalBodyDirty.emit();
+            }
         }
 
-        int width, height;
+        shared_ptr<SimulatedScene> scene;
+        uint64_t lastFrameIndex = UINT64_MAX;
+        BufferPool<uint16_t> depthPool, infraredPool;
+        BufferPool<uint8_t> bodyIndexPool, colorPool;
+        shared_ptr<uint8_t> colorBuffer;
+
+        // Image sequence replay
+        struct SequenceFrame
+        {
+            fs::path depthPath, colorPath;
+        };
+        vector<SequenceFrame> sequence;
+        ivec2 sequenceDepthSize, sequenceColorSize;
+
+        // Frame index % kRingSize picks the slot. A slot is ready once pending is 0, jobs of frames whose slot has
+        // been handed to a later frame drop their result.
+        static const int kRingSize = 8;
+        struct Slot
+        {
+            uint64_t frameIndex = UINT64_MAX;
+            int pending = 0;
+            Channel16uRef depth;
+            Surface8uRef color;
+        };
+        Slot ring[kRingSize];
+        mutex ringMutex;
+        WorkerPool decodePool;
+        Surface8uRef colorFrame; // owns the pixels of colorSurface
     };
 
     uint32_t getSimulatorCount() { return 1; }
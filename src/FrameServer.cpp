@@ -0,0 +1,245 @@
+#include "FrameServer.h"
+
+#include "cinder/Log.h"
+
+#include "SharedFrames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <random>
+#include <type_traits>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static_assert(is_trivially_copyable<Body>::value, "bodies are shared as raw bytes");
+
+    using namespace SharedFrames;
+
+    static size_t roundUp64(size_t n) { return (n + 63) & ~size_t(63); }
+
+    // Marks the slot of the next frame as being written, returns its frame number
+    static Slot* beginFrame(const SharedMapping& memory, uint64_t* frame)
+    {
+        *frame = getHeader(memory)->latest.load(memory_order_relaxed) + 1;
+        Slot* slot = getSlot(memory, *frame);
+        slot->sequence.store(*frame * 2 - 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        return slot;
+    }
+
+    static void endFrame(const SharedMapping& memory, Slot* slot, uint64_t frame)
+    {
+        slot->sequence.store(frame * 2, memory_order_release);
+        getHeader(memory)->latest.store(frame, memory_order_release);
+    }
+
+    FrameServer::FrameServer() {}
+
+    FrameServer::~FrameServer() { close(); }
+
+    bool FrameServer::setup(const DeviceRef& device, const Options& options)
+    {
+        close();
+        if (!device || !device->isValid())
+        {
+            CI_LOG_E("FrameServer needs a valid device");
+            return false;
+        }
+        this->device = device;
+        this->options = options;
+        this->options.slotCount = max(options.slotCount, 2);
+        serverId = random_device()() ^ (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+        streams.resize(STREAM_COUNT);
+        directories.resize(STREAM_COUNT);
+        isStreamFailed.assign(STREAM_COUNT, 0);
+        // A random start keeps the names clear of objects a client may still map from a previous server
+        generations.assign(STREAM_COUNT, serverId & 0xFFF);
+
+        Device* d = device.get();
+        connections.emplace_back(d->signalDepthDirty.connect([this] { publish(DEPTH); }));
+        connections.emplace_back(d->signalInfraredDirty.connect([this] { publish(INFRARED); }));
+        connections.emplace_back(d->signalBodyIndexDirty.connect([this] { publish(BODY_INDEX); }));
+        connections.emplace_back(d->signalColorDirty.connect([this] { publish(COLOR); }));
+        connections.emplace_back(d->signalBodyDirty.connect([this] { publish(BODY); }));
+        connections.emplace_back(d->signalDepthToCameraTableDirty.connect([this] { publish(DEPTH_TO_CAMERA_TABLE); }));
+        connections.emplace_back(d->signalDepthToColorTableDirty.connect([this] { publish(DEPTH_TO_COLOR_TABLE); }));
+
+        // Some backends emit once and early, like the point cloud tables built in their constructors
+        for (int s = 0; s < STREAM_COUNT; s++)
+            if (s != BODY || !d->bodies.empty())
+                publish(s);
+        return true;
+    }
+
+    void FrameServer::close()
+    {
+        connections.clear();
+        for (auto& memory : streams)
+        {
+            if (memory && memory->isOpen())
+                getHeader(*memory)->isClosed.store(1, memory_order_release);
+            memory.reset();
+        }
+        for (auto& directory : directories)
+            directory.reset();
+        device.reset();
+    }
+
+    SharedMapping* FrameServer::getStream(int stream, size_t slotBytes)
+    {
+        auto& memory = streams[stream];
+        if (memory && getHeader(*memory)->slotBytes >= slotBytes)
+            return memory.get();
+        if (isStreamFailed[stream])
+            return nullptr;
+
+        auto& directory = directories[stream];
+        if (!directory)
+        {
+            directory.reset(new SharedMapping);
+            if (!directory->create(getObjectName(options.name, (Stream)stream), kDirectoryBytes))
+            {
+                isStreamFailed[stream] = 1;
+                directory.reset();
+                return nullptr;
+            }
+            memset(directory->getData(), 0, kDirectoryBytes);
+            Directory* entry = getDirectory(*directory);
+            new (&entry->generation) atomic<uint64_t>(0);
+            entry->magic = kMagic;
+            entry->version = kVersion;
+            entry->serverId = serverId;
+        }
+
+        // First frame, or a bigger one: a new object under the next generation's name, clients drop the old one and
+        // open the new one
+        const uint64_t generation = generations[stream] + 1;
+        unique_ptr<SharedMapping> next(new SharedMapping);
+        const size_t bytes = kHeaderBytes + options.slotCount * slotBytes;
+        if (!next->create(getObjectName(options.name, (Stream)stream, generation), bytes))
+        {
+            isStreamFailed[stream] = 1;
+            return nullptr;
+        }
+        generations[stream] = generation;
+        if (memory)
+            getHeader(*memory)->isClosed.store(1, memory_order_release);
+        memory = move(next);
+
+        memset(memory->getData(), 0, bytes);
+        Header* header = getHeader(*memory);
+        new (&header->latest) atomic<uint64_t>(0);
+        new (&header->isClosed) atomic<uint32_t>(0);
+        header->magic = kMagic;
+        header->version = kVersion;
+        header->slotCount = options.slotCount;
+        header->bodyBytes = sizeof(Body);
+        header->slotBytes = slotBytes;
+        header->serverId = serverId;
+        header->generation = generation;
+        header->depthToMmScale = device->getDepthToMmScale();
+        header->focalLength[0] = device->focalLength.x;
+        header->focalLength[1] = device->focalLength.y;
+        for (int i = 0; i < options.slotCount; i++)
+            new (&getSlot(*memory, i)->sequence) atomic<uint64_t>(0);
+        getDirectory(*directory)->generation.store(generation, memory_order_release);
+        return memory.get();
+    }
+
+    void FrameServer::publish(int stream)
+    {
+        const Device* d = device.get();
+        switch (stream)
+        {
+        case DEPTH:
+        {
+            const auto& c = d->depthChannel;
+            publishImage(DEPTH, c.getData(), c.getWidth(), c.getHeight(), c.getRowBytes(), sizeof(uint16_t), 0, 0);
+            break;
+        }
+        case INFRARED:
+        {
+            const auto& c = d->infraredChannel;
+            publishImage(INFRARED, c.getData(), c.getWidth(), c.getHeight(), c.getRowBytes(), sizeof(uint16_t), 0, 0);
+            break;
+        }
+        case BODY_INDEX:
+        {
+            const auto& c = d->bodyIndexChannel;
+            publishImage(BODY_INDEX, c.getData(), c.getWidth(), c.getHeight(), c.getRowBytes(), sizeof(uint8_t), 0,
+                         d->bodyTimestamp);
+            break;
+        }
+        case COLOR:
+        {
+            const auto& s = d->colorSurface;
+            publishImage(COLOR, s.getData(), s.getWidth(), s.getHeight(), s.getRowBytes(), s.getPixelInc(),
+                         s.getChannelOrder().getCode(), 0);
+            break;
+        }
+        case BODY:
+            publishBodies();
+            break;
+        case DEPTH_TO_CAMERA_TABLE:
+        case DEPTH_TO_COLOR_TABLE:
+        {
+            const auto& s = stream == DEPTH_TO_CAMERA_TABLE ? d->depthToCameraTable : d->depthToColorTable;
+            publishImage(stream, s.getData(), s.getWidth(), s.getHeight(), s.getRowBytes(),
+                         s.getPixelInc() * sizeof(float), s.getChannelOrder().getCode(), 0);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void FrameServer::publishImage(int stream, const void* data, int32_t width, int32_t height, ptrdiff_t rowBytes,
+                                   int32_t pixelBytes, int32_t channelOrder, uint64_t timestamp)
+    {
+        if (data == nullptr || width <= 0 || height <= 0)
+            return;
+        const size_t packedRowBytes = (size_t)width * pixelBytes;
+        SharedMapping* memory = getStream(stream, roundUp64(kSlotHeaderBytes + packedRowBytes * height));
+        if (memory == nullptr)
+            return;
+
+        uint64_t frame;
+        Slot* slot = beginFrame(*memory, &frame);
+        slot->timestamp = timestamp;
+        slot->width = width;
+        slot->height = height;
+        slot->rowBytes = (int32_t)packedRowBytes;
+        slot->pixelBytes = pixelBytes;
+        slot->channelOrder = channelOrder;
+        slot->count = 0;
+        uint8_t* dst = getSlotData(slot);
+        const uint8_t* src = (const uint8_t*)data;
+        if ((size_t)rowBytes == packedRowBytes)
+            memcpy(dst, src, packedRowBytes * height);
+        else
+            for (int32_t y = 0; y < height; y++)
+                memcpy(dst + y * packedRowBytes, src + y * rowBytes, packedRowBytes);
+        endFrame(*memory, slot, frame);
+    }
+
+    void FrameServer::publishBodies()
+    {
+        SharedMapping* memory = getStream(BODY, kSlotHeaderBytes + kMaxBodies * sizeof(Body));
+        if (memory == nullptr)
+            return;
+
+        const size_t count = min(device->bodies.size(), kMaxBodies);
+        uint64_t frame;
+        Slot* slot = beginFrame(*memory, &frame);
+        slot->timestamp = device->bodyTimestamp;
+        slot->width = slot->height = slot->rowBytes = slot->pixelBytes = slot->channelOrder = 0;
+        slot->count = (uint32_t)count;
+        memcpy(getSlotData(slot), device->bodies.data(), count * sizeof(Body));
+        endFrame(*memory, slot, frame);
+    }
+} // namespace ds
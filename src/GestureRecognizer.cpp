@@ -0,0 +1,513 @@
+#include "GestureRecognizer.h"
+#include "Simd.h"
+
+#include "cinder/app/App.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static const float kFar = 1e30f;
+    static const size_t kFeatureStride = (Body::JOINT_COUNT + 3) & ~3;
+
+    static size_t roundUp4(size_t n) { return (n + 3) & ~size_t(3); }
+
+#ifdef DS_USE_SSE2
+    static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+#endif
+
+    GestureRecognizer::Template GestureRecognizer::Template::swipe(const string& name, Body::JointType hand,
+                                                                   const vec3& direction, float distance,
+                                                                   float duration)
+    {
+        Template result;
+        result.name = name;
+        result.kind = MOTION;
+        result.joint = hand;
+        result.reference = Body::SHOULDER_CENTER;
+        result.direction = direction;
+        result.distance = distance;
+        result.duration = duration;
+        return result;
+    }
+
+    GestureRecognizer::Template GestureRecognizer::Template::push(const string& name, Body::JointType hand,
+                                                                  float distance, float duration)
+    {
+        return swipe(name, hand, vec3(0, 0, 1), distance, duration);
+    }
+
+    GestureRecognizer::Template GestureRecognizer::Template::raise(const string& name, Body::JointType hand,
+                                                                   float height, float duration)
+    {
+        const Constraint above = {hand, Body::HEAD, vec3(0, 1, 0), height, numeric_limits<float>::max()};
+        return pose(name, {above}, duration);
+    }
+
+    GestureRecognizer::Template GestureRecognizer::Template::pose(const string& name,
+                                                                  const vector<Constraint>& constraints,
+                                                                  float duration)
+    {
+        Template result;
+        result.name = name;
+        result.kind = POSE;
+        result.constraints = constraints;
+        result.duration = duration;
+        return result;
+    }
+
+    GestureRecognizer::Template GestureRecognizer::Template::sequence(const string& name,
+                                                                      const vector<Body::JointType>& joints,
+                                                                      const vector<vector<vec3>>& frames,
+                                                                      float threshold)
+    {
+        Template result;
+        result.name = name;
+        result.kind = SEQUENCE;
+        result.joints = joints;
+        result.frames = frames;
+        result.threshold = threshold;
+        return result;
+    }
+
+    bool GestureRecognizer::toBodyFrame(const Body& body, vec3* positions)
+    {
+        const vec3& origin = body.joints[Body::SHOULDER_CENTER].pos3d;
+        vec3 up = origin - body.joints[Body::HIP_CENTER].pos3d;
+        const float spine = length(up);
+        if (!(spine > 1e-6f))
+            return false;
+        up /= spine;
+
+        vec3 right = body.joints[Body::SHOULDER_RIGHT].pos3d - body.joints[Body::SHOULDER_LEFT].pos3d;
+        right -= up * dot(right, up);
+        if (length(right) < spine * 1e-3f)
+            return false;
+        right = normalize(right);
+        const vec3 forward = cross(up, right);
+
+        const float scale = 0.5f / spine;
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            const vec3 p = body.joints[j].pos3d - origin;
+            positions[j] = vec3(dot(p, right), dot(p, up), dot(p, forward)) * scale;
+        }
+        return true;
+    }
+
+    void GestureRecognizer::setup(const Options& options)
+    {
+        this->options = options;
+        this->options.maxBodies = max<size_t>(options.maxBodies, 1);
+        slots.setup(this->options.maxBodies);
+        isCompiled = false;
+    }
+
+    size_t GestureRecognizer::addTemplate(const Template& gesture)
+    {
+        templates.push_back(gesture);
+        isCompiled = false;
+        return templates.size() - 1;
+    }
+
+    void GestureRecognizer::clearTemplates()
+    {
+        templates.clear();
+        isCompiled = false;
+    }
+
+    void GestureRecognizer::attach(Device* device)
+    {
+        if (slots.size() == 0)
+            setup();
+        connection = device->signalBodyDirty.connect([this, device] {
+            double seconds = device->bodyTimestamp ? device->bodyTimestamp * 1e-6 : app::getElapsedSeconds();
+            process(device->bodies, seconds);
+        });
+    }
+
+    void GestureRecognizer::detach() { connection.disconnect(); }
+
+    void GestureRecognizer::reset()
+    {
+        slots.reset();
+        epoch = -1;
+    }
+
+    void GestureRecognizer::compile()
+    {
+        motion = Lanes();
+        pose = Lanes();
+        poseBegin.clear();
+        poseGestures.clear();
+        sequences.clear();
+        sequenceJoints.clear();
+
+        // Motion lanes keep distance in minimum and duration in maximum
+        for (size_t g = 0; g < templates.size(); g++)
+        {
+            const Template& t = templates[g];
+            if (t.kind == Template::MOTION)
+            {
+                motion.count++;
+                motion.joints.push_back(t.joint);
+                motion.references.push_back(t.reference);
+                motion.gestures.push_back((int)g);
+            }
+            else if (t.kind == Template::POSE)
+            {
+                poseBegin.push_back(pose.count);
+                poseGestures.push_back(g);
+                for (const auto& c : t.constraints)
+                {
+                    pose.count++;
+                    pose.joints.push_back(c.joint);
+                    pose.references.push_back(c.reference);
+                    pose.gestures.push_back((int)g);
+                }
+            }
+            else if (!t.frames.empty() && !t.joints.empty())
+            {
+                Sequence s;
+                s.gesture = g;
+                s.length = t.frames.size();
+                s.stride = roundUp4(s.length);
+                s.joints = t.joints.size();
+                s.firstJoint = sequenceJoints.size();
+                s.points = 0;
+                s.column = 0;
+                if (!sequences.empty())
+                {
+                    const Sequence& last = sequences.back();
+                    s.points = last.points + last.joints * last.stride;
+                    s.column = last.column + last.stride + 4;
+                }
+                for (auto j : t.joints)
+                    sequenceJoints.push_back(j);
+                sequences.push_back(s);
+            }
+        }
+        poseBegin.push_back(pose.count);
+        for (Lanes* lanes : {&motion, &pose})
+        {
+            lanes->stride = roundUp4(lanes->count);
+            lanes->joints.resize(lanes->stride, 0);
+            lanes->references.resize(lanes->stride, 0);
+            lanes->gestures.resize(lanes->stride, -1);
+        }
+
+        size_t pointCount = 0, longest = 0;
+        for (const auto& s : sequences)
+        {
+            pointCount += s.joints * s.stride;
+            longest = max(longest, s.stride);
+        }
+        columnStride = sequences.empty() ? 0 : roundUp4(sequences.back().column + sequences.back().stride + 4);
+
+        // Carve every array out of one aligned buffer, all sizes are multiples of 4
+        const size_t slotCount = options.maxBodies;
+        vector<pair<float**, size_t>> arrays = {
+            {&features[0], kFeatureStride}, {&features[1], kFeatureStride}, {&features[2], kFeatureStride},
+            {&motionStart, slotCount * motion.stride}, {&motionStartSeconds, slotCount * motion.stride},
+            {&poseHoldSeconds, roundUp4(slotCount * poseGestures.size())},
+            {&pointX, pointCount}, {&pointY, pointCount}, {&pointZ, pointCount},
+            {&distances, longest}, {&steps, longest}, {&columns, slotCount * columnStride}};
+        for (Lanes* lanes : {&motion, &pose})
+            for (float** p : {&lanes->axisX, &lanes->axisY, &lanes->axisZ, &lanes->minimum, &lanes->maximum,
+                              &lanes->values})
+                arrays.push_back(make_pair(p, lanes->stride));
+        size_t total = 0;
+        for (const auto& a : arrays)
+            total += a.second;
+        storage.assign(total + 3, 0.0f);
+        float* p = storage.data();
+        p += ((16 - (uintptr_t)p % 16) % 16) / sizeof(float);
+        for (const auto& a : arrays)
+            *a.first = p, p += a.second;
+
+        // Padding lanes never pass or fire
+        fill(motion.minimum, motion.minimum + motion.stride, kFar);
+        fill(pose.minimum, pose.minimum + pose.stride, kFar);
+        size_t m = 0, c = 0;
+        for (const auto& t : templates)
+        {
+            if (t.kind == Template::MOTION)
+            {
+                const vec3 direction = length(t.direction) > 0 ? normalize(t.direction) : vec3(0);
+                motion.axisX[m] = direction.x, motion.axisY[m] = direction.y, motion.axisZ[m] = direction.z;
+                motion.minimum[m] = t.distance;
+                motion.maximum[m] = t.duration;
+                m++;
+            }
+            else if (t.kind == Template::POSE)
+            {
+                for (const auto& constraint : t.constraints)
+                {
+                    const vec3 axis = length(constraint.axis) > 0 ? normalize(constraint.axis) : vec3(0);
+                    pose.axisX[c] = axis.x, pose.axisY[c] = axis.y, pose.axisZ[c] = axis.z;
+                    pose.minimum[c] = constraint.minimum;
+                    pose.maximum[c] = constraint.maximum;
+                    c++;
+                }
+            }
+        }
+        for (const auto& s : sequences)
+        {
+            const Template& t = templates[s.gesture];
+            for (size_t j = 0; j < s.joints; j++)
+            {
+                float *x = pointX + s.points + j * s.stride, *y = pointY + s.points + j * s.stride,
+                      *z = pointZ + s.points + j * s.stride;
+                for (size_t i = 0; i < s.stride; i++)
+                {
+                    // Padding repeats the last frame, its distances are computed but never read
+                    const auto& frame = t.frames[min(i, s.length - 1)];
+                    const vec3 point = j < frame.size() ? frame[j] : vec3(0);
+                    x[i] = point.x, y[i] = point.y, z[i] = point.z;
+                }
+            }
+        }
+
+        isPoseFired.assign(slotCount * poseGestures.size(), 0);
+        lastFired.assign(slotCount * templates.size(), -kFar);
+        slots.reset();
+        isCompiled = true;
+    }
+
+    void GestureRecognizer::claimSlot(size_t slot, float seconds)
+    {
+        fill(motionStart + slot * motion.stride, motionStart + (slot + 1) * motion.stride, kFar);
+        fill(motionStartSeconds + slot * motion.stride, motionStartSeconds + (slot + 1) * motion.stride, seconds);
+        fill(poseHoldSeconds + slot * poseGestures.size(), poseHoldSeconds + (slot + 1) * poseGestures.size(), -1.0f);
+        fill(isPoseFired.begin() + slot * poseGestures.size(), isPoseFired.begin() + (slot + 1) * poseGestures.size(),
+             0);
+        fill(lastFired.begin() + slot * templates.size(), lastFired.begin() + (slot + 1) * templates.size(), -kFar);
+        float* column = columns + slot * columnStride;
+        fill(column, column + columnStride, kFar);
+        for (const auto& s : sequences)
+            column[s.column] = 0;
+    }
+
+    void GestureRecognizer::emit(size_t slot, size_t gesture, float seconds, float score)
+    {
+        float& last = lastFired[slot * templates.size() + gesture];
+        if (seconds - last < templates[gesture].cooldown)
+            return;
+        last = seconds;
+        const Event event = {slots.getId(slot), gesture, epoch + seconds, score};
+        signalGesture.emit(event);
+    }
+
+    // values[l] = dot(features[joints[l]] - features[references[l]], axis[l])
+    static void evaluateLanes(const int* joints, const int* references, const float* axisX, const float* axisY,
+                              const float* axisZ, float* values, size_t stride, float* const* features)
+    {
+        const float *fx = features[0], *fy = features[1], *fz = features[2];
+        size_t l = 0;
+#ifdef DS_USE_SSE2
+        for (; l < stride; l += 4)
+        {
+            const int* a = joints + l;
+            const int* b = references + l;
+            const __m128 dx = _mm_sub_ps(_mm_setr_ps(fx[a[0]], fx[a[1]], fx[a[2]], fx[a[3]]),
+                                         _mm_setr_ps(fx[b[0]], fx[b[1]], fx[b[2]], fx[b[3]]));
+            const __m128 dy = _mm_sub_ps(_mm_setr_ps(fy[a[0]], fy[a[1]], fy[a[2]], fy[a[3]]),
+                                         _mm_setr_ps(fy[b[0]], fy[b[1]], fy[b[2]], fy[b[3]]));
+            const __m128 dz = _mm_sub_ps(_mm_setr_ps(fz[a[0]], fz[a[1]], fz[a[2]], fz[a[3]]),
+                                         _mm_setr_ps(fz[b[0]], fz[b[1]], fz[b[2]], fz[b[3]]));
+            __m128 v = _mm_mul_ps(dx, _mm_load_ps(axisX + l));
+            v = _mm_add_ps(v, _mm_mul_ps(dy, _mm_load_ps(axisY + l)));
+            v = _mm_add_ps(v, _mm_mul_ps(dz, _mm_load_ps(axisZ + l)));
+            _mm_store_ps(values + l, v);
+        }
+#endif
+        for (; l < stride; l++)
+        {
+            const int a = joints[l], b = references[l];
+            values[l] = (fx[a] - fx[b]) * axisX[l] + (fy[a] - fy[b]) * axisY[l] + (fz[a] - fz[b]) * axisZ[l];
+        }
+    }
+
+    void GestureRecognizer::process(const vector<Body>& bodies, double seconds)
+    {
+        if (slots.size() == 0)
+            setup();
+        if (!isCompiled)
+            compile();
+        if (epoch < 0)
+            epoch = seconds;
+        const float now = (float)(seconds - epoch);
+
+        slots.match(bodies);
+
+        vec3 positions[Body::JOINT_COUNT];
+        for (size_t b = 0; b < bodies.size(); b++)
+        {
+            const int slot = slots.getSlot(b);
+            if (slot < 0)
+                continue;
+            if (slots.isNew(b))
+                claimSlot(slot, now);
+            if (!toBodyFrame(bodies[b], positions))
+                continue;
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                features[0][j] = positions[j].x;
+                features[1][j] = positions[j].y;
+                features[2][j] = positions[j].z;
+            }
+
+            // Motion: the start point follows the joint backwards and forgets after duration, the gesture fires once
+            // the joint is distance ahead of it
+            if (motion.count)
+            {
+                evaluateLanes(motion.joints.data(), motion.references.data(), motion.axisX, motion.axisY,
+                              motion.axisZ, motion.values, motion.stride, features);
+                float* start = motionStart + slot * motion.stride;
+                float* startSeconds = motionStartSeconds + slot * motion.stride;
+                float* travelled = motion.values; // overwritten in place, 0 where nothing fired
+                size_t l = 0;
+#ifdef DS_USE_SSE2
+                const __m128 vNow = _mm_set1_ps(now);
+                for (; l < motion.stride; l += 4)
+                {
+                    const __m128 value = _mm_load_ps(motion.values + l);
+                    __m128 s0 = _mm_load_ps(start + l), t0 = _mm_load_ps(startSeconds + l);
+                    const __m128 expired = _mm_cmpgt_ps(_mm_sub_ps(vNow, t0), _mm_load_ps(motion.maximum + l));
+                    const __m128 restart = _mm_or_ps(_mm_cmplt_ps(value, s0), expired);
+                    s0 = select(restart, value, s0);
+                    t0 = select(restart, vNow, t0);
+                    const __m128 distance = _mm_sub_ps(value, s0);
+                    const __m128 fired = _mm_cmpge_ps(distance, _mm_load_ps(motion.minimum + l));
+                    _mm_store_ps(travelled + l, _mm_and_ps(fired, distance));
+                    _mm_store_ps(start + l, select(fired, value, s0));
+                    _mm_store_ps(startSeconds + l, select(fired, vNow, t0));
+                }
+#endif
+                for (; l < motion.stride; l++)
+                {
+                    const float value = motion.values[l];
+                    if (value < start[l] || now - startSeconds[l] > motion.maximum[l])
+                        start[l] = value, startSeconds[l] = now;
+                    const float distance = value - start[l];
+                    travelled[l] = 0;
+                    if (distance >= motion.minimum[l])
+                        travelled[l] = distance, start[l] = value, startSeconds[l] = now;
+                }
+                for (l = 0; l < motion.count; l++)
+                    if (travelled[l] > 0)
+                        emit(slot, motion.gestures[l], now, travelled[l]);
+            }
+
+            // Pose: every lane of a template in range, held for duration, fires once per hold
+            if (pose.count)
+            {
+                evaluateLanes(pose.joints.data(), pose.references.data(), pose.axisX, pose.axisY, pose.axisZ,
+                              pose.values, pose.stride, features);
+                size_t l = 0;
+#ifdef DS_USE_SSE2
+                const __m128 one = _mm_set1_ps(1.0f);
+                for (; l < pose.stride; l += 4)
+                {
+                    const __m128 value = _mm_load_ps(pose.values + l);
+                    const __m128 inside = _mm_and_ps(_mm_cmpge_ps(value, _mm_load_ps(pose.minimum + l)),
+                                                     _mm_cmple_ps(value, _mm_load_ps(pose.maximum + l)));
+                    _mm_store_ps(pose.values + l, _mm_and_ps(inside, one));
+                }
+#endif
+                for (; l < pose.stride; l++)
+                    pose.values[l] = pose.values[l] >= pose.minimum[l] && pose.values[l] <= pose.maximum[l];
+
+                for (size_t i = 0; i < poseGestures.size(); i++)
+                {
+                    bool isHeld = true;
+                    for (size_t c = poseBegin[i]; c < poseBegin[i + 1] && isHeld; c++)
+                        isHeld = pose.values[c] > 0;
+                    float& holdSeconds = poseHoldSeconds[slot * poseGestures.size() + i];
+                    uint8_t& isFired = isPoseFired[slot * poseGestures.size() + i];
+                    if (!isHeld)
+                    {
+                        holdSeconds = -1;
+                        isFired = 0;
+                        continue;
+                    }
+                    if (holdSeconds < 0)
+                        holdSeconds = now;
+                    const float held = now - holdSeconds;
+                    if (!isFired && held >= templates[poseGestures[i]].duration)
+                    {
+                        isFired = 1;
+                        emit(slot, poseGestures[i], now, held);
+                    }
+                }
+            }
+
+            // Sequence: one new column of subsequence DTW (start anywhere) per frame. Moving down from the previous
+            // column is vectorized, moving along the new column is a scalar prefix min.
+            float* slotColumns = columns + slot * columnStride;
+            for (const auto& s : sequences)
+            {
+                const float* x = pointX + s.points;
+                const float* y = pointY + s.points;
+                const float* z = pointZ + s.points;
+                float* column = slotColumns + s.column; // column[0] stays 0, column[i + 1] is frame i
+                size_t i = 0;
+#ifdef DS_USE_SSE2
+                for (; i < s.stride; i += 4)
+                {
+                    __m128 sum = _mm_setzero_ps();
+                    for (size_t j = 0; j < s.joints; j++)
+                    {
+                        const int joint = sequenceJoints[s.firstJoint + j];
+                        const size_t k = j * s.stride + i;
+                        const __m128 dx = _mm_sub_ps(_mm_set1_ps(features[0][joint]), _mm_load_ps(x + k));
+                        const __m128 dy = _mm_sub_ps(_mm_set1_ps(features[1][joint]), _mm_load_ps(y + k));
+                        const __m128 dz = _mm_sub_ps(_mm_set1_ps(features[2][joint]), _mm_load_ps(z + k));
+                        sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_add_ps(_mm_mul_ps(dy, dy),
+                                                                                         _mm_mul_ps(dz, dz))));
+                    }
+                    _mm_store_ps(distances + i, sum);
+                    const __m128 previous = _mm_min_ps(_mm_loadu_ps(column + i), _mm_loadu_ps(column + i + 1));
+                    _mm_store_ps(steps + i, _mm_add_ps(sum, previous));
+                }
+#endif
+                for (; i < s.stride; i++)
+                {
+                    float sum = 0;
+                    for (size_t j = 0; j < s.joints; j++)
+                    {
+                        const int joint = sequenceJoints[s.firstJoint + j];
+                        const size_t k = j * s.stride + i;
+                        const float dx = features[0][joint] - x[k], dy = features[1][joint] - y[k],
+                                    dz = features[2][joint] - z[k];
+                        sum += dx * dx + dy * dy + dz * dz;
+                    }
+                    distances[i] = sum;
+                    steps[i] = sum + min(column[i], column[i + 1]);
+                }
+
+                float cost = 0;
+                for (i = 0; i < s.length; i++)
+                {
+                    cost = min(steps[i], cost + distances[i]);
+                    column[i + 1] = cost;
+                }
+
+                const float rms = sqrt(cost / (s.length * s.joints));
+                if (rms <= templates[s.gesture].threshold)
+                {
+                    emit(slot, s.gesture, now, rms);
+                    fill(column + 1, column + 1 + s.length, kFar);
+                }
+            }
+        }
+    }
+} // namespace ds
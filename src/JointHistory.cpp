@@ -0,0 +1,246 @@
+#include "JointHistory.h"
+
+#include "cinder/app/App.h"
+
+#include <algorithm>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    static const uint64_t kNoBody = UINT64_MAX; // frameFirsts of an empty slot
+
+    void JointHistory::setup(const Options& options)
+    {
+        this->options = options;
+        this->options.maxBodies = max<size_t>(options.maxBodies, 1);
+        this->options.capacity = max<size_t>(options.capacity, 2);
+        frameCapacity = this->options.capacity + 1;
+        const size_t frameSlots = frameCapacity * this->options.maxBodies;
+
+        slots.setup(this->options.maxBodies);
+
+        frameSeconds.assign(frameCapacity, 0);
+        frameIds.assign(frameSlots, 0);
+        frameFirsts.assign(frameSlots, kNoBody);
+        samples.assign(frameSlots * Body::JOINT_COUNT, Sample());
+        frameCount = 0;
+        frameWriting = 0;
+    }
+
+    void JointHistory::attach(Device* device)
+    {
+        if (samples.empty())
+            setup();
+        connection = device->signalBodyDirty.connect([this, device] {
+            double seconds = device->bodyTimestamp ? device->bodyTimestamp * 1e-6 : app::getElapsedSeconds();
+            push(device->bodies, seconds);
+        });
+    }
+
+    void JointHistory::detach() { connection.disconnect(); }
+
+    void JointHistory::reset() { slots.reset(); }
+
+    void JointHistory::push(const vector<Body>& bodies, double seconds)
+    {
+        if (samples.empty())
+            setup();
+
+        slots.match(bodies);
+
+        // Announce the frame before touching its storage, so readers of the frame it replaces can tell
+        const uint64_t frame = frameCount.load(memory_order_relaxed);
+        frameWriting.store(frame, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        const size_t row = (frame % frameCapacity) * options.maxBodies;
+        const size_t previousRow = ((frame + frameCapacity - 1) % frameCapacity) * options.maxBodies;
+        frameSeconds[frame % frameCapacity] = seconds;
+        fill(frameFirsts.begin() + row, frameFirsts.begin() + row + options.maxBodies, kNoBody);
+
+        for (size_t b = 0; b < bodies.size(); b++)
+        {
+            const int s = slots.getSlot(b);
+            if (s < 0)
+                continue;
+            const bool isNew = slots.isNew(b);
+            frameIds[row + s] = bodies[b].id;
+            frameFirsts[row + s] = isNew ? frame : frameFirsts[previousRow + s];
+
+            for (int j = 0; j < Body::JOINT_COUNT; j++)
+            {
+                const vec3& p = bodies[b].joints[j].pos3d;
+                Sample& sample = at(frame, s, j);
+                sample.position = p;
+                for (int c = 0; c < 3; c++)
+                {
+                    const Sample* previous = isNew ? nullptr : &at(frame - 1, s, j);
+                    sample.sum[c] = (previous ? previous->sum[c] : 0.0) + p[c];
+                    sample.sumSq[c] = (previous ? previous->sumSq[c] : 0.0) + (double)p[c] * p[c];
+                }
+            }
+        }
+        frameCount.store(frame + 1, memory_order_release);
+    }
+
+    // Runs reader(newest frame, slot, first frame of id, samples available, &oldest frame read) on the newest frame
+    // holding id, and retries when the writer may have overwritten what it read, seqlock style
+    template <typename Reader>
+    bool JointHistory::read(uint64_t id, Reader reader) const
+    {
+        if (samples.empty())
+            return false;
+        for (;;)
+        {
+            const uint64_t count = frameCount.load(memory_order_acquire);
+            if (count == 0)
+                return false;
+            const uint64_t newest = count - 1;
+            const size_t row = (newest % frameCapacity) * options.maxBodies;
+
+            bool result = false;
+            uint64_t oldest = newest;
+            for (size_t s = 0; s < options.maxBodies; s++)
+            {
+                const uint64_t first = frameFirsts[row + s];
+                if (first != kNoBody && first <= newest && frameIds[row + s] == id)
+                {
+                    const size_t available = (size_t)min<uint64_t>(newest + 1 - first, options.capacity);
+                    result = reader(newest, s, first, available, &oldest);
+                    break;
+                }
+            }
+
+            atomic_thread_fence(memory_order_acquire);
+            if (oldest + frameCapacity > frameWriting.load(memory_order_relaxed))
+                return result;
+        }
+    }
+
+    size_t JointHistory::getIds(uint64_t* ids, size_t maxCount) const
+    {
+        if (samples.empty())
+            return 0;
+        for (;;)
+        {
+            const uint64_t count = frameCount.load(memory_order_acquire);
+            if (count == 0)
+                return 0;
+            const uint64_t newest = count - 1;
+            const size_t row = (newest % frameCapacity) * options.maxBodies;
+
+            size_t written = 0;
+            for (size_t s = 0; s < options.maxBodies && written < maxCount; s++)
+                if (frameFirsts[row + s] != kNoBody)
+                    ids[written++] = frameIds[row + s];
+
+            atomic_thread_fence(memory_order_acquire);
+            if (newest + frameCapacity > frameWriting.load(memory_order_relaxed))
+                return written;
+        }
+    }
+
+    size_t JointHistory::getSampleCount(uint64_t id) const
+    {
+        size_t result = 0;
+        read(id, [&](uint64_t, size_t, uint64_t, size_t available, uint64_t*) {
+            result = available;
+            return true;
+        });
+        return result;
+    }
+
+    bool JointHistory::getPosition(uint64_t id, int joint, vec3* position, size_t age) const
+    {
+        return read(id, [&](uint64_t newest, size_t slot, uint64_t /*first*/, size_t available, uint64_t* oldest) {
+            if (age >= available)
+                return false;
+            *oldest = newest - age;
+            *position = at(*oldest, slot, joint).position;
+            return true;
+        });
+    }
+
+    bool JointHistory::getVelocity(uint64_t id, int joint, vec3* velocity, size_t age) const
+    {
+        return read(id, [&](uint64_t newest, size_t slot, uint64_t /*first*/, size_t available, uint64_t* oldest) {
+            if (age + 2 > available)
+                return false;
+            const uint64_t f1 = newest - age, f0 = f1 - 1;
+            *oldest = f0;
+            const double dt = frameSeconds[f1 % frameCapacity] - frameSeconds[f0 % frameCapacity];
+            if (dt <= 0)
+                return false;
+            *velocity = (at(f1, slot, joint).position - at(f0, slot, joint).position) / (float)dt;
+            return true;
+        });
+    }
+
+    bool JointHistory::getAcceleration(uint64_t id, int joint, vec3* acceleration, size_t age) const
+    {
+        return read(id, [&](uint64_t newest, size_t slot, uint64_t /*first*/, size_t available, uint64_t* oldest) {
+            if (age + 3 > available)
+                return false;
+            const uint64_t f2 = newest - age, f1 = f2 - 1, f0 = f2 - 2;
+            *oldest = f0;
+            const double t0 = frameSeconds[f0 % frameCapacity], t1 = frameSeconds[f1 % frameCapacity],
+                         t2 = frameSeconds[f2 % frameCapacity];
+            if (t1 <= t0 || t2 <= t1)
+                return false;
+            const vec3& p0 = at(f0, slot, joint).position;
+            const vec3& p1 = at(f1, slot, joint).position;
+            const vec3& p2 = at(f2, slot, joint).position;
+            const vec3 v01 = (p1 - p0) / (float)(t1 - t0), v12 = (p2 - p1) / (float)(t2 - t1);
+            *acceleration = (v12 - v01) * (float)(2 / (t2 - t0));
+            return true;
+        });
+    }
+
+    bool JointHistory::getStats(uint64_t id, int joint, size_t window, Stats* stats) const
+    {
+        return read(id, [&](uint64_t newest, size_t slot, uint64_t first, size_t available, uint64_t* oldest) {
+            const size_t count = min(window, available);
+            if (count == 0)
+                return false;
+            const Sample& last = at(newest, slot, joint);
+            const Sample* before = nullptr; // the sample ahead of the window, none if it starts at the first one
+            *oldest = newest + 1 - count;
+            if (newest + 1 - count > first)
+            {
+                *oldest = newest - count;
+                before = &at(*oldest, slot, joint);
+            }
+            stats->count = count;
+            for (int c = 0; c < 3; c++)
+            {
+                const double mean = (last.sum[c] - (before ? before->sum[c] : 0.0)) / count;
+                const double meanSq = (last.sumSq[c] - (before ? before->sumSq[c] : 0.0)) / count;
+                stats->mean[c] = (float)mean;
+                stats->variance[c] = (float)max(meanSq - mean * mean, 0.0);
+            }
+            return true;
+        });
+    }
+
+    size_t JointHistory::getSamples(uint64_t id, int joint, size_t maxCount, vec3* positions, double* seconds) const
+    {
+        size_t result = 0;
+        read(id, [&](uint64_t newest, size_t slot, uint64_t /*first*/, size_t available, uint64_t* oldest) {
+            result = min(maxCount, available);
+            if (result == 0)
+                return false;
+            *oldest = newest + 1 - result;
+            for (size_t i = 0; i < result; i++)
+            {
+                if (positions)
+                    positions[i] = at(*oldest + i, slot, joint).position;
+                if (seconds)
+                    seconds[i] = frameSeconds[(*oldest + i) % frameCapacity];
+            }
+            return true;
+        });
+        return result;
+    }
+} // namespace ds
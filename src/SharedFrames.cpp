@@ -0,0 +1,161 @@
+#include "SharedFrames.h"
+
+#include "cinder/Log.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+
+using namespace std;
+
+namespace ds
+{
+#if defined(_WIN32)
+    bool SharedMapping::create(const string& name, size_t bytes)
+    {
+        close();
+        const string objectName = "Local\\" + name;
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32),
+                                    (DWORD)bytes, objectName.c_str());
+        if (handle == nullptr)
+        {
+            CI_LOG_E("CreateFileMapping " << objectName << " failed: " << GetLastError());
+            return false;
+        }
+        // A mapping still held open by a client keeps its old size, it can not be replaced
+        const bool isStale = GetLastError() == ERROR_ALREADY_EXISTS;
+        data = (uint8_t*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info = {};
+        if (data == nullptr || VirtualQuery(data, &info, sizeof(info)) == 0 || info.RegionSize < bytes)
+        {
+            CI_LOG_E(objectName << " is " << (isStale ? "held by another process with a different size" : "unmappable"));
+            close();
+            return false;
+        }
+        this->name = objectName;
+        size = bytes;
+        isOwner = true;
+        return true;
+    }
+
+    bool SharedMapping::open(const string& name)
+    {
+        close();
+        const string objectName = "Local\\" + name;
+        handle = OpenFileMappingA(FILE_MAP_READ, FALSE, objectName.c_str());
+        if (handle == nullptr)
+            return false;
+        data = (uint8_t*)MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info = {};
+        if (data == nullptr || VirtualQuery(data, &info, sizeof(info)) == 0)
+        {
+            close();
+            return false;
+        }
+        this->name = objectName;
+        size = info.RegionSize;
+        return true;
+    }
+
+    void SharedMapping::close()
+    {
+        if (data)
+            UnmapViewOfFile(data);
+        if (handle)
+            CloseHandle(handle);
+        data = nullptr;
+        handle = nullptr;
+        size = 0;
+        isOwner = false;
+    }
+#else
+    bool SharedMapping::create(const string& name, size_t bytes)
+    {
+        close();
+        const string objectName = "/" + name;
+        // Clients keep mapping the old object until they reopen the name
+        shm_unlink(objectName.c_str());
+        int fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+        {
+            CI_LOG_E("shm_open " << objectName << " failed: " << strerror(errno));
+            return false;
+        }
+        void* mapping = MAP_FAILED;
+        if (ftruncate(fd, (off_t)bytes) == 0)
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            CI_LOG_E("Failed to map " << bytes << " bytes of " << objectName << ": " << strerror(errno));
+            shm_unlink(objectName.c_str());
+            return false;
+        }
+        this->name = objectName;
+        data = (uint8_t*)mapping;
+        size = bytes;
+        isOwner = true;
+        return true;
+    }
+
+    bool SharedMapping::open(const string& name)
+    {
+        close();
+        const string objectName = "/" + name;
+        int fd = shm_open(objectName.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+        this->name = objectName;
+        data = (uint8_t*)mapping;
+        size = (size_t)info.st_size;
+        return true;
+    }
+
+    void SharedMapping::close()
+    {
+        if (data)
+            munmap(data, size);
+        if (isOwner)
+            shm_unlink(name.c_str());
+        data = nullptr;
+        size = 0;
+        isOwner = false;
+    }
+#endif
+
+    namespace SharedFrames
+    {
+        string getObjectName(const string& serverName, Stream stream)
+        {
+            static const char* names[STREAM_COUNT] = {"depth", "ir", "index", "color", "body", "xyz", "uv"};
+            return "ds_" + serverName.substr(0, 16) + "_" + names[stream];
+        }
+
+        string getObjectName(const string& serverName, Stream stream, uint64_t generation)
+        {
+            // Three hex digits: a client would have to hold an object through 4096 resizes to collide with it
+            char suffix[8];
+            snprintf(suffix, sizeof(suffix), "_%03x", (unsigned)(generation & 0xFFF));
+            return getObjectName(serverName, stream) + suffix;
+        }
+    } // namespace SharedFrames
+} // namespace ds
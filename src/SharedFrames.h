@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ds
+{
+    // A named shared memory object mapped into this process, read/write by the process that created it and read-only
+    // by the ones that open it
+    struct SharedMapping
+    {
+        SharedMapping() = default;
+        SharedMapping(const SharedMapping&) = delete;
+        SharedMapping& operator=(const SharedMapping&) = delete;
+        ~SharedMapping() { close(); }
+
+        // Replaces any object left with the same name
+        bool create(const std::string& name, size_t bytes);
+        bool open(const std::string& name);
+        void close();
+
+        bool isOpen() const { return data != nullptr; }
+        uint8_t* getData() const { return data; }
+        size_t getSize() const { return size; }
+
+      private:
+        std::string name;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        bool isOwner = false;
+#if defined(_WIN32)
+        void* handle = nullptr;
+#endif
+    };
+
+    // One shared memory object per stream of a FrameServer: a header, then slotCount slots of slotBytes. Frame n
+    // (from 1) goes to slot n % slotCount. A bigger frame gets a new object under a new name, since Windows keeps an
+    // object alive at its old size while any client maps it; a small directory object under the stream's base name
+    // tells clients the current one. Both sides must be built from the same sources, Body is copied as is.
+    namespace SharedFrames
+    {
+        enum Stream
+        {
+            DEPTH,
+            INFRARED,
+            BODY_INDEX,
+            COLOR,
+            BODY,
+            DEPTH_TO_CAMERA_TABLE,
+            DEPTH_TO_COLOR_TABLE,
+            STREAM_COUNT
+        };
+
+        static const uint32_t kMagic = 0x53465344; // "DSFS"
+        static const uint32_t kVersion = 3;
+        static const size_t kDirectoryBytes = 64;
+        static const size_t kHeaderBytes = 256;
+        static const size_t kSlotHeaderBytes = 64;
+        static const size_t kMaxBodies = 16;
+
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared frames need lock-free 64-bit atomics");
+
+        struct Directory
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t serverId;
+            std::atomic<uint64_t> generation; // of the current object, 0 before the first
+        };
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slotCount;
+            uint32_t bodyBytes;         // sizeof(Body) of the server
+            uint64_t slotBytes;
+            uint64_t serverId;          // random per FrameServer::setup()
+            uint64_t generation;        // names the object, counts up from a random start per server
+            float depthToMmScale;
+            float focalLength[2];
+            std::atomic<uint64_t> latest;  // newest complete frame, 0 before the first
+            std::atomic<uint32_t> isClosed; // set when the server goes away
+        };
+
+        // Frame data follows at kSlotHeaderBytes, rows of an image packed at rowBytes
+        struct Slot
+        {
+            std::atomic<uint64_t> sequence; // 2n - 1 while frame n is written, 2n once it is complete
+            uint64_t timestamp;             // device us, 0 when unknown
+            int32_t width, height;
+            int32_t rowBytes, pixelBytes;
+            int32_t channelOrder;           // SurfaceChannelOrder code of color and tables
+            uint32_t count;                 // bodies
+        };
+
+        static_assert(sizeof(Directory) <= kDirectoryBytes && sizeof(Header) <= kHeaderBytes &&
+                          sizeof(Slot) <= kSlotHeaderBytes,
+                      "shared frames layout");
+
+        // Names of the directory and of the frames objects of stream, short enough for macOS (31 characters with the
+        // slash)
+        std::string getObjectName(const std::string& serverName, Stream stream);
+        std::string getObjectName(const std::string& serverName, Stream stream, uint64_t generation);
+
+        inline Directory* getDirectory(const SharedMapping& memory) { return (Directory*)memory.getData(); }
+        inline Header* getHeader(const SharedMapping& memory) { return (Header*)memory.getData(); }
+        inline Slot* getSlot(const SharedMapping& memory, uint64_t frame)
+        {
+            const Header* header = getHeader(memory);
+            return (Slot*)(memory.getData() + kHeaderBytes + (frame % header->slotCount) * header->slotBytes);
+        }
+        inline uint8_t* getSlotData(Slot* slot) { return (uint8_t*)slot + kSlotHeaderBytes; }
+    } // namespace SharedFrames
+} // namespace ds
@@ -0,0 +1,8 @@
+#pragma once
+
+// SSE2 comes with every x64 target and with -msse2 elsewhere. Kernels guard their intrinsics with DS_USE_SSE2
+// and keep a scalar path that gives the same results for other targets.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DS_USE_SSE2
+#endif
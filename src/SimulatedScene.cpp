@@ -0,0 +1,685 @@
+#include "SimulatedScene.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ci;
+using namespace std;
+
+namespace ds
+{
+    namespace
+    {
+        const float kPi = 3.14159265f;
+        const int kWall = -1, kFloor = -2;
+
+        uint64_t splitmix(uint64_t x)
+        {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+        // Cheap per-row generator, seeded from splitmix so rows don't depend on the thread that renders them
+        struct Random
+        {
+            explicit Random(uint64_t seed) : state((uint32_t)splitmix(seed) | 1) {}
+
+            float uniform()
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                return (state >> 8) * (1.0f / 16777216.0f);
+            }
+
+            // Irwin-Hall approximation of a unit normal
+            float normal() { return (uniform() + uniform() + uniform() + uniform() - 2.0f) * 1.7320508f; }
+
+            uint32_t state;
+        };
+
+        vec3 rotateY(const vec3& v, float angle)
+        {
+            float c = cos(angle), s = sin(angle);
+            return {c * v.x + s * v.z, v.y, -s * v.x + c * v.z};
+        }
+
+        // Distance t along a unit direction from the origin, or a negative value for a miss
+        float intersectSphere(const vec3& dir, const vec3& center, float radius)
+        {
+            float b = dot(dir, center);
+            float h = b * b - dot(center, center) + radius * radius;
+            if (h < 0)
+                return -1;
+            return b - sqrt(h);
+        }
+
+        float intersectBox(const vec3& dir, const vec3& center, const vec3& halfSize, float yaw)
+        {
+            vec3 o = rotateY(-center, -yaw), d = rotateY(dir, -yaw);
+            float tNear = -1e30f, tFar = 1e30f;
+            for (int k = 0; k < 3; k++)
+            {
+                if (abs(d[k]) < 1e-9f)
+                {
+                    if (abs(o[k]) > halfSize[k])
+                        return -1;
+                    continue;
+                }
+                float t1 = (-halfSize[k] - o[k]) / d[k], t2 = (halfSize[k] - o[k]) / d[k];
+                tNear = max(tNear, min(t1, t2));
+                tFar = min(tFar, max(t1, t2));
+            }
+            return tNear <= tFar && tNear > 0 ? tNear : -1;
+        }
+
+        float intersectCapsule(const vec3& dir, const vec3& pa, const vec3& pb, float radius)
+        {
+            vec3 ba = pb - pa, oa = -pa;
+            float baba = dot(ba, ba), bard = dot(ba, dir), baoa = dot(ba, oa), rdoa = dot(dir, oa);
+            float a = baba - bard * bard;
+            float b = baba * rdoa - baoa * bard;
+            float c = baba * dot(oa, oa) - baoa * baoa - radius * radius * baba;
+            float h = b * b - a * c;
+            if (h < 0)
+                return -1;
+            if (a > 1e-12f)
+            {
+                float t = (-b - sqrt(h)) / a;
+                float y = baoa + t * bard;
+                if (y > 0 && y < baba)
+                    return t;
+            }
+            // end caps
+            float y = baoa + (-b / max(a, 1e-12f)) * bard;
+            vec3 oc = y <= 0 ? oa : -pb;
+            b = dot(dir, oc);
+            h = b * b - dot(oc, oc) + radius * radius;
+            return h > 0 ? -b - sqrt(h) : -1;
+        }
+
+        float intersect(const vec3& dir, const SimulatedScene::Primitive& p)
+        {
+            switch (p.type)
+            {
+            case SimulatedScene::Primitive::SPHERE:
+                return intersectSphere(dir, p.a, p.radius);
+            case SimulatedScene::Primitive::BOX:
+                return intersectBox(dir, p.a, p.b, p.radius);
+            default:
+                return intersectCapsule(dir, p.a, p.b, p.radius);
+            }
+        }
+
+        vec3 getNormal(const vec3& point, const SimulatedScene::Primitive& p)
+        {
+            switch (p.type)
+            {
+            case SimulatedScene::Primitive::SPHERE:
+                return (point - p.a) / p.radius;
+            case SimulatedScene::Primitive::BOX:
+            {
+                // the face whose slab the point is closest to leaving
+                vec3 local = rotateY(point - p.a, -p.radius), n;
+                int axis = 0;
+                for (int k = 1; k < 3; k++)
+                    if (abs(local[k]) / p.b[k] > abs(local[axis]) / p.b[axis])
+                        axis = k;
+                n[axis] = local[axis] < 0 ? -1.0f : 1.0f;
+                return rotateY(n, p.radius);
+            }
+            default:
+            {
+                vec3 ba = p.b - p.a;
+                float s = clamp(dot(point - p.a, ba) / dot(ba, ba), 0.0f, 1.0f);
+                return (point - (p.a + ba * s)) / p.radius;
+            }
+            }
+        }
+
+        float getBoundingRadius(const SimulatedScene::Primitive& p, vec3* center)
+        {
+            switch (p.type)
+            {
+            case SimulatedScene::Primitive::SPHERE:
+                *center = p.a;
+                return p.radius;
+            case SimulatedScene::Primitive::BOX:
+                *center = p.a;
+                return length(p.b);
+            default:
+                *center = (p.a + p.b) * 0.5f;
+                return length(p.b - p.a) * 0.5f + p.radius;
+            }
+        }
+
+        // Signed distance from p to the surface, negative inside
+        float getDistance(const vec3& point, const SimulatedScene::Primitive& p)
+        {
+            switch (p.type)
+            {
+            case SimulatedScene::Primitive::SPHERE:
+                return distance(point, p.a) - p.radius;
+            case SimulatedScene::Primitive::BOX:
+            {
+                vec3 q = rotateY(point - p.a, -p.radius);
+                vec3 d(abs(q.x) - p.b.x, abs(q.y) - p.b.y, abs(q.z) - p.b.z);
+                return length(vec3(max(d.x, 0.0f), max(d.y, 0.0f), max(d.z, 0.0f))) +
+                       min(max(d.x, max(d.y, d.z)), 0.0f);
+            }
+            default:
+            {
+                vec3 ba = p.b - p.a;
+                float s = clamp(dot(point - p.a, ba) / dot(ba, ba), 0.0f, 1.0f);
+                return distance(point, p.a + ba * s) - p.radius;
+            }
+            }
+        }
+
+        uint8_t toByte(float v) { return (uint8_t)(clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+        // Rotation whose columns are the given orthonormal axes
+        quat toQuat(const vec3& x, const vec3& y, const vec3& z)
+        {
+            float trace = x.x + y.y + z.z;
+            if (trace > 0)
+            {
+                float s = 0.5f / sqrt(trace + 1.0f);
+                return quat(0.25f / s, (y.z - z.y) * s, (z.x - x.z) * s, (x.y - y.x) * s);
+            }
+            if (x.x > y.y && x.x > z.z)
+            {
+                float s = 2.0f * sqrt(1.0f + x.x - y.y - z.z);
+                return quat((y.z - z.y) / s, 0.25f * s, (y.x + x.y) / s, (z.x + x.z) / s);
+            }
+            if (y.y > z.z)
+            {
+                float s = 2.0f * sqrt(1.0f + y.y - x.x - z.z);
+                return quat((z.x - x.z) / s, (y.x + x.y) / s, 0.25f * s, (z.y + y.z) / s);
+            }
+            float s = 2.0f * sqrt(1.0f + z.z - x.x - y.y);
+            return quat((x.y - y.x) / s, (z.x + x.z) / s, (z.y + y.z) / s, 0.25f * s);
+        }
+
+    } // namespace
+
+    void SimulatedScene::Camera::setup(int width, int height, float horizontalFovDegrees)
+    {
+        this->width = width;
+        this->height = height;
+        fx = fy = width * 0.5f / tan(horizontalFovDegrees * kPi / 360.0f);
+        cx = width * 0.5f;
+        cy = height * 0.5f;
+    }
+
+    shared_ptr<SimulatedScene> SimulatedScene::createDefault(uint32_t seed)
+    {
+        auto scene = make_shared<SimulatedScene>();
+        scene->seed = seed;
+        scene->camera.setup(640, 480);
+
+        Random random(seed);
+        auto jitter = [&](float range) { return (random.uniform() * 2 - 1) * range; };
+        const float floorY = -scene->floorHeight;
+
+        Prop ball;
+        ball.shape.type = Primitive::SPHERE;
+        ball.shape.radius = 0.25f;
+        ball.shape.a = {-1.0f + jitter(0.3f), floorY + 0.6f, 3.0f + jitter(0.3f)};
+        ball.shape.color = {0.9f, 0.2f, 0.1f};
+        ball.amplitude = {0, 0.35f, 0};
+        ball.frequency = 0.5f;
+        ball.phase = jitter(kPi);
+        scene->props.push_back(ball);
+
+        Prop pendulum;
+        pendulum.shape.type = Primitive::SPHERE;
+        pendulum.shape.radius = 0.15f;
+        pendulum.shape.a = {jitter(0.3f), floorY + 0.5f, 2.2f + jitter(0.2f)};
+        pendulum.shape.color = {0.1f, 0.7f, 0.2f};
+        pendulum.amplitude = {1.2f, 0, 0};
+        pendulum.frequency = 0.3f;
+        pendulum.phase = jitter(kPi);
+        scene->props.push_back(pendulum);
+
+        Prop crate;
+        crate.shape.type = Primitive::BOX;
+        crate.shape.a = {1.2f + jitter(0.2f), floorY + 0.35f, 3.5f + jitter(0.3f)};
+        crate.shape.b = {0.4f, 0.35f, 0.3f};
+        crate.shape.color = {0.6f, 0.45f, 0.25f};
+        crate.spin = 0.5f + jitter(0.2f);
+        scene->props.push_back(crate);
+
+        Prop pillar;
+        pillar.shape.type = Primitive::BOX;
+        pillar.shape.a = {-1.8f + jitter(0.2f), floorY + 0.5f, 3.5f};
+        pillar.shape.b = {0.2f, 0.5f, 0.2f};
+        pillar.shape.color = {0.3f, 0.3f, 0.8f};
+        pillar.amplitude = {0, 0, 1.0f};
+        pillar.frequency = 0.2f;
+        pillar.phase = jitter(kPi);
+        scene->props.push_back(pillar);
+
+        Walker walker;
+        walker.from = {-2.0f, 2.8f + jitter(0.3f)};
+        walker.to = {2.0f, 3.2f + jitter(0.3f)};
+        walker.height = 1.75f + jitter(0.1f);
+        walker.phase = random.uniform();
+        walker.id = 1;
+        scene->walkers.push_back(walker);
+
+        walker.from = {1.5f, 4.2f + jitter(0.2f)};
+        walker.to = {-1.5f, 2.5f + jitter(0.2f)};
+        walker.height = 1.65f + jitter(0.1f);
+        walker.speed = 0.9f;
+        walker.phase = random.uniform();
+        walker.shirt = {0.8f, 0.7f, 0.2f};
+        walker.pants = {0.15f, 0.15f, 0.35f};
+        walker.id = 2;
+        scene->walkers.push_back(walker);
+
+        scene->update(0);
+        return scene;
+    }
+
+    shared_ptr<SimulatedScene> SimulatedScene::createCrowd(int bodyCount, uint32_t seed)
+    {
+        auto scene = make_shared<SimulatedScene>();
+        scene->seed = seed;
+        scene->camera.setup(640, 480);
+        bodyCount = max(1, min(bodyCount, (int)kMaxCrowd));
+
+        // Rows of up to 8 people 0.9 m apart, each crossing the view and stepping out of it at both ends
+        Random random(seed);
+        const float halfFov = 0.5f * scene->camera.width / scene->camera.fx;
+        for (int i = 0; i < bodyCount; i++)
+        {
+            const float z = 2.0f + 0.9f * (i / 8) + 0.3f * random.uniform();
+            const float x = halfFov * z + 0.5f;
+            const bool isLeftward = (i & 1) != 0;
+
+            Walker walker;
+            walker.from = {isLeftward ? x : -x, z};
+            walker.to = {isLeftward ? -x : x, z + (random.uniform() - 0.5f) * 0.6f};
+            walker.height = 1.5f + 0.45f * random.uniform();
+            walker.speed = 0.8f + 0.8f * random.uniform();
+            walker.phase = random.uniform();
+            walker.shirt = {random.uniform(), random.uniform(), random.uniform()};
+            walker.pants = vec3(0.1f + 0.3f * random.uniform());
+            walker.id = i + 1;
+            scene->walkers.push_back(walker);
+            scene->wallDistance = max(scene->wallDistance, z + 1.5f);
+        }
+
+        scene->update(0);
+        return scene;
+    }
+
+    void SimulatedScene::update(double seconds)
+    {
+        time = seconds;
+        primitives.clear();
+        bodies.clear();
+        bodyBounds.clear();
+
+        for (auto& prop : props)
+        {
+            Primitive shape = prop.shape;
+            vec3 offset = prop.amplitude * (float)sin(2 * kPi * prop.frequency * seconds + prop.phase);
+            shape.a += offset;
+            if (shape.type == Primitive::CAPSULE)
+                shape.b += offset;
+            if (shape.type == Primitive::BOX)
+                shape.radius += prop.spin * (float)seconds;
+            primitives.push_back(shape);
+        }
+
+        for (size_t i = 0; i < walkers.size(); i++)
+            addWalker(walkers[i], (uint8_t)min<size_t>(i, 254));
+        updateConfidences();
+    }
+
+    void SimulatedScene::addWalker(const Walker& walker, uint8_t bodyIndex)
+    {
+        // Position along the back-and-forth path and how far the feet have gone
+        vec3 from(walker.from.x, -floorHeight, walker.from.y), to(walker.to.x, -floorHeight, walker.to.y);
+        float pathLength = max(distance(from, to), 1e-3f);
+        float traveled = walker.speed * (float)time + walker.phase * pathLength;
+        float u = fmod(traveled, 2 * pathLength);
+        vec3 forward = (to - from) / pathLength;
+        vec3 ground = u < pathLength ? from + forward * u : to - forward * (u - pathLength);
+        if (u >= pathLength)
+            forward = -forward;
+
+        const float h = walker.height;
+        const vec3 up(0, 1, 0), right = cross(up, forward);
+        // one gait cycle is two steps
+        const float gait = 2 * kPi * traveled / (0.8f * h);
+        auto at = [&](float heightFraction, float side, float front) {
+            return ground + up * (h * heightFraction) + right * (h * side) + forward * (h * front);
+        };
+        auto limb = [&](float angle) { return up * -cos(angle) + forward * sin(angle); };
+
+        Body body;
+        body.id = walker.id;
+        vec3 joints[Body::JOINT_COUNT];
+        const float bob = 0.01f * cos(2 * gait);
+        joints[Body::HIP_CENTER] = at(0.53f + bob, 0, 0);
+        joints[Body::SPINE] = at(0.66f + bob, 0, 0);
+        joints[Body::SHOULDER_CENTER] = at(0.81f + bob, 0, 0);
+        joints[Body::NECK] = at(0.85f + bob, 0, 0);
+        joints[Body::HEAD] = at(0.92f + bob, 0, 0);
+
+        for (int s = -1; s <= 1; s += 2)
+        {
+            const bool isLeft = s < 0;
+            // left and right are half a cycle apart, arms swing against the leg on their side
+            const float legPhase = gait + (isLeft ? 0 : kPi);
+            const float swing = 0.35f * sin(legPhase);
+            const float kneeBend = 0.05f + 0.3f * max(0.0f, sin(legPhase - 0.5f));
+            const float armSwing = -0.3f * sin(legPhase);
+
+            vec3 hip = at(0.52f + bob, 0.06f * s, 0);
+            vec3 knee = hip + limb(swing) * (0.245f * h);
+            vec3 ankle = knee + limb(swing - kneeBend) * (0.245f * h);
+            vec3 foot = ankle + forward * (0.1f * h) - up * (0.02f * h);
+
+            vec3 shoulder = at(0.8f + bob, 0.13f * s, 0);
+            vec3 elbow = shoulder + limb(armSwing) * (0.17f * h) + right * (0.01f * h * s);
+            vec3 forearm = limb(armSwing + 0.25f);
+            vec3 wrist = elbow + forearm * (0.15f * h);
+
+            joints[isLeft ? Body::HIP_LEFT : Body::HIP_RIGHT] = hip;
+            joints[isLeft ? Body::KNEE_LEFT : Body::KNEE_RIGHT] = knee;
+            joints[isLeft ? Body::ANKLE_LEFT : Body::ANKLE_RIGHT] = ankle;
+            joints[isLeft ? Body::FOOT_LEFT : Body::FOOT_RIGHT] = foot;
+            joints[isLeft ? Body::SHOULDER_LEFT : Body::SHOULDER_RIGHT] = shoulder;
+            joints[isLeft ? Body::ELBOW_LEFT : Body::ELBOW_RIGHT] = elbow;
+            joints[isLeft ? Body::WRIST_LEFT : Body::WRIST_RIGHT] = wrist;
+            joints[isLeft ? Body::HAND_LEFT : Body::HAND_RIGHT] = wrist + forearm * (0.05f * h);
+            joints[isLeft ? Body::HAND_TIP_LEFT : Body::HAND_TIP_RIGHT] = wrist + forearm * (0.09f * h);
+            joints[isLeft ? Body::HAND_THUMB_LEFT : Body::HAND_THUMB_RIGHT] =
+                wrist + forearm * (0.04f * h) + forward * (0.02f * h) - right * (0.02f * h * s);
+            joints[isLeft ? Body::EYE_LEFT : Body::EYE_RIGHT] =
+                joints[Body::HEAD] + forward * (0.05f * h) + up * (0.02f * h) + right * (0.018f * h * s);
+            joints[isLeft ? Body::EAR_LEFT : Body::EAR_RIGHT] = joints[Body::HEAD] + right * (0.045f * h * s);
+        }
+        joints[Body::NOSE] = joints[Body::HEAD] + forward * (0.06f * h);
+
+        // Y runs along the joint's bone (the first one leaving it, or the one ending in it), z is the walking
+        // direction made orthogonal to it
+        for (int j = 0; j < Body::NOSE; j++)
+        {
+            vec3 bone;
+            for (const auto& b : Body::bones)
+                if (b[0] == j)
+                {
+                    bone = joints[b[1]] - joints[j];
+                    break;
+                }
+            if (bone == vec3())
+                for (const auto& b : Body::bones)
+                    if (b[1] == j)
+                        bone = joints[j] - joints[b[0]];
+
+            vec3 y = normalize(bone);
+            vec3 z = forward - y * dot(forward, y);
+            z = length(z) > 1e-3f ? normalize(z) : normalize(cross(right, y));
+            body.joints[j].orientation = toQuat(cross(y, z), y, z);
+        }
+        for (int j = Body::NOSE; j < Body::JOINT_COUNT; j++)
+            body.joints[j].orientation = body.joints[Body::HEAD].orientation;
+
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+        {
+            auto& joint = body.joints[j];
+            joint.pos3d = joints[j];
+            joint.pos2d = camera.project(joints[j]);
+        }
+        bodies.push_back(body);
+
+        BodyBounds bounds;
+        bounds.begin = primitives.size();
+        bounds.center = joints[Body::SPINE];
+        bounds.radius = 0;
+        for (int j = 0; j < Body::JOINT_COUNT; j++)
+            bounds.radius = max(bounds.radius, distance(joints[j], bounds.center));
+        bounds.radius += 0.1f * h;
+
+        auto addCapsule = [&](Body::JointType a, Body::JointType b, float radius, const vec3& color) {
+            Primitive capsule;
+            capsule.type = Primitive::CAPSULE;
+            capsule.a = joints[a];
+            capsule.b = joints[b];
+            capsule.radius = radius * h;
+            capsule.color = color;
+            capsule.bodyIndex = bodyIndex;
+            primitives.push_back(capsule);
+        };
+
+        Primitive head;
+        head.a = joints[Body::HEAD];
+        head.radius = 0.06f * h;
+        head.color = walker.skin;
+        head.bodyIndex = bodyIndex;
+        primitives.push_back(head);
+
+        addCapsule(Body::HIP_CENTER, Body::SHOULDER_CENTER, 0.1f, walker.shirt);
+        addCapsule(Body::SHOULDER_LEFT, Body::ELBOW_LEFT, 0.028f, walker.shirt);
+        addCapsule(Body::SHOULDER_RIGHT, Body::ELBOW_RIGHT, 0.028f, walker.shirt);
+        addCapsule(Body::ELBOW_LEFT, Body::WRIST_LEFT, 0.024f, walker.skin);
+        addCapsule(Body::ELBOW_RIGHT, Body::WRIST_RIGHT, 0.024f, walker.skin);
+        addCapsule(Body::WRIST_LEFT, Body::HAND_TIP_LEFT, 0.02f, walker.skin);
+        addCapsule(Body::WRIST_RIGHT, Body::HAND_TIP_RIGHT, 0.02f, walker.skin);
+        addCapsule(Body::HIP_LEFT, Body::KNEE_LEFT, 0.05f, walker.pants);
+        addCapsule(Body::HIP_RIGHT, Body::KNEE_RIGHT, 0.05f, walker.pants);
+        addCapsule(Body::KNEE_LEFT, Body::ANKLE_LEFT, 0.037f, walker.pants);
+        addCapsule(Body::KNEE_RIGHT, Body::ANKLE_RIGHT, 0.037f, walker.pants);
+        addCapsule(Body::ANKLE_LEFT, Body::FOOT_LEFT, 0.025f, vec3(0.1f));
+        addCapsule(Body::ANKLE_RIGHT, Body::FOOT_RIGHT, 0.025f, vec3(0.1f));
+
+        bounds.end = primitives.size();
+        bodyBounds.push_back(bounds);
+    }
+
+    bool SimulatedScene::isOccluded(const vec3& point) const
+    {
+        const float z = length(point);
+        const vec3 dir = point / z;
+        // Primitives the point is inside of can't hide it, that's the body part it belongs to
+        auto hides = [&](const Primitive& p) {
+            float t = ds::intersect(dir, p);
+            return t > 0 && t < z - 0.01f && getDistance(point, p) > 0;
+        };
+
+        for (size_t i = 0; i < props.size(); i++)
+            if (hides(primitives[i]))
+                return true;
+        for (const auto& bounds : bodyBounds)
+        {
+            float t = intersectSphere(dir, bounds.center, bounds.radius);
+            if (t < 0 || t > z)
+                continue;
+            for (size_t i = bounds.begin; i < bounds.end; i++)
+                if (hides(primitives[i]))
+                    return true;
+        }
+        return false;
+    }
+
+    void SimulatedScene::updateConfidences()
+    {
+        // NONE out of view, LOW when hidden from the camera (the tracker would be guessing), HIGH otherwise
+        for (auto& body : bodies)
+            for (auto& joint : body.joints)
+            {
+                const vec2& p = joint.pos2d;
+                if (joint.pos3d.z < 0.1f || p.x < 0 || p.x >= 1 || p.y < 0 || p.y >= 1)
+                    joint.confidence = Body::JOINT_CONFIDENCE_NONE;
+                else if (isOccluded(joint.pos3d))
+                    joint.confidence = Body::JOINT_CONFIDENCE_LOW;
+                else
+                    joint.confidence = Body::JOINT_CONFIDENCE_HIGH;
+            }
+    }
+
+    bool SimulatedScene::intersect(const vec2& ray, Hit* hit) const
+    {
+        const vec3 dir = normalize(vec3(ray, 1.0f));
+
+        float z = wallDistance;
+        int id = kWall;
+        if (ray.y < 0 && -floorHeight / ray.y < z)
+        {
+            z = -floorHeight / ray.y;
+            id = kFloor;
+        }
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            float t = ds::intersect(dir, primitives[i]);
+            if (t > 0 && t * dir.z < z)
+            {
+                z = t * dir.z;
+                id = (int)i;
+            }
+        }
+
+        hit->z = z;
+        getSurface(vec3(ray, 1.0f) * z, id, hit);
+        return true;
+    }
+
+    void SimulatedScene::getSurface(const vec3& point, int id, Hit* hit) const
+    {
+        hit->bodyIndex = 255;
+        if (id == kWall)
+        {
+            hit->normal = {0, 0, -1};
+            hit->color = {0.85f, 0.8f, 0.7f};
+        }
+        else if (id == kFloor)
+        {
+            // 0.5 m tiles give color trackers some texture
+            bool odd = ((int)floor(point.x * 2) + (int)floor(point.z * 2)) & 1;
+            hit->normal = {0, 1, 0};
+            hit->color = vec3(odd ? 0.45f : 0.6f);
+        }
+        else
+        {
+            const auto& p = primitives[id];
+            hit->normal = getNormal(point, p);
+            hit->color = p.color;
+            hit->bodyIndex = p.bodyIndex;
+        }
+    }
+
+    void SimulatedScene::render(const Frame& frame, uint64_t frameIndex) const
+    {
+        if (!frame.depth && !frame.infrared && !frame.color && !frame.bodyIndex)
+            return;
+
+        const int width = camera.width, height = camera.height;
+        zBuffer.resize(width * height);
+        idBuffer.resize(width * height);
+
+        // Screen rows and columns each primitive can cover, from the corners of its bounding sphere's box
+        struct Bounds
+        {
+            int x0, y0, x1, y1;
+        };
+        vector<Bounds> bounds(primitives.size());
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            vec3 c;
+            float r = getBoundingRadius(primitives[i], &c);
+            Bounds& b = bounds[i];
+            if (c.z - r < 0.05f)
+            {
+                b = {0, 0, width - 1, height - 1};
+                continue;
+            }
+            float nearZ = c.z - r, farZ = c.z + r;
+            float xMin = min((c.x - r) / nearZ, (c.x - r) / farZ), xMax = max((c.x + r) / nearZ, (c.x + r) / farZ);
+            float yMin = min((c.y - r) / nearZ, (c.y - r) / farZ), yMax = max((c.y + r) / nearZ, (c.y + r) / farZ);
+            b.x0 = max(0, (int)floor(camera.cx + camera.fx * xMin) - 1);
+            b.x1 = min(width - 1, (int)ceil(camera.cx + camera.fx * xMax) + 1);
+            b.y0 = max(0, (int)floor(camera.cy - camera.fy * yMax) - 1);
+            b.y1 = min(height - 1, (int)ceil(camera.cy - camera.fy * yMin) + 1);
+        }
+
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int y = 0; y < height; y++)
+        {
+            float* zRow = &zBuffer[y * width];
+            int* idRow = &idBuffer[y * width];
+            const float ry = camera.getRay(0, y).y;
+
+            for (int x = 0; x < width; x++)
+            {
+                float floorZ = ry < 0 ? -floorHeight / ry : 1e30f;
+                zRow[x] = min(wallDistance, floorZ);
+                idRow[x] = floorZ < wallDistance ? kFloor : kWall;
+            }
+
+            for (size_t i = 0; i < primitives.size(); i++)
+            {
+                const Bounds& b = bounds[i];
+                if (y < b.y0 || y > b.y1)
+                    continue;
+                for (int x = b.x0; x <= b.x1; x++)
+                {
+                    vec3 ray(camera.getRay(x, y), 1.0f);
+                    float invLength = 1.0f / length(ray);
+                    float t = ds::intersect(ray * invLength, primitives[i]);
+                    float z = t * invLength;
+                    if (t > 0 && z < zRow[x])
+                    {
+                        zRow[x] = z;
+                        idRow[x] = (int)i;
+                    }
+                }
+            }
+
+            Random random(splitmix(seed) ^ splitmix(frameIndex * 0x10000 + y));
+            for (int x = 0; x < width; x++)
+            {
+                const float z = zRow[x];
+                const vec3 ray(camera.getRay(x, y), 1.0f);
+                Hit hit;
+                getSurface(ray * z, idRow[x], &hit);
+                const vec3& color = hit.color;
+                const float shade = abs(dot(hit.normal, ray)) / length(ray);
+                const size_t index = (size_t)y * width + x;
+
+                if (frame.depth)
+                {
+                    float mm = z * 1000.0f;
+                    if (depthNoise > 0)
+                        mm += random.normal() * depthNoise * z * z;
+                    bool isHole = shade < 0.12f || (holeRate > 0 && random.uniform() < holeRate);
+                    frame.depth[index] = isHole ? 0 : (uint16_t)clamp(mm + 0.5f, 0.0f, 65535.0f);
+                }
+                if (frame.infrared)
+                {
+                    float albedo = 0.3f * color.x + 0.59f * color.y + 0.11f * color.z;
+                    frame.infrared[index] = (uint16_t)clamp(4000.0f * albedo * shade / max(z * z, 0.1f), 0.0f, 65535.0f);
+                }
+                if (frame.color)
+                {
+                    vec3 lit = color * (0.35f + 0.65f * shade);
+                    uint8_t* bgrx = frame.color + index * 4;
+                    bgrx[0] = toByte(lit.z);
+                    bgrx[1] = toByte(lit.y);
+                    bgrx[2] = toByte(lit.x);
+                    bgrx[3] = 255;
+                }
+                if (frame.bodyIndex)
+                {
+                    frame.bodyIndex[index] = hit.bodyIndex;
+                }
+            }
+        }
+    }
+} // namespace ds
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ds
+{
+    // Publishes tracked items (Body, Face) into a Device vector without allocating once set up. An item keeps its
+    // entry from frame to frame while its id is tracked, entries of lost ids are dropped at end() with the order
+    // of the others kept, and their storage (e.g. Face::vertices) is recycled for the next new id. At most
+    // capacity items are tracked at once, acquire() returns null beyond that.
+    //
+    // The vector stays dense since apps iterate it as is, so addresses are only stable until the next end():
+    // dropping a lost id moves the entries behind it down (their storage moves with them, nothing is copied).
+    // Code that follows an id across frames keys on Body::id, not on the entry address or index.
+    //
+    // Per frame: begin(), acquire() each tracked id and fill the entry in place, end().
+    template <typename T> struct TrackedSlots
+    {
+        // prototype is copied into each spare entry, so that e.g. vertex buffers are sized up front
+        void setup(std::vector<T>* items, size_t capacity, const T& prototype = T())
+        {
+            this->items = items;
+            this->capacity = capacity;
+            items->clear();
+            items->reserve(capacity);
+            spare.assign(capacity, prototype);
+            isSeen.reserve(capacity);
+        }
+
+        void begin() { isSeen.assign(items->size(), 0); }
+
+        T* acquire(uint64_t id)
+        {
+            for (size_t i = 0; i < items->size(); i++)
+            {
+                if ((*items)[i].id == id)
+                {
+                    isSeen[i] = 1;
+                    return &(*items)[i];
+                }
+            }
+
+            if (items->size() >= capacity)
+                return nullptr;
+            if (spare.empty())
+                items->emplace_back();
+            else
+            {
+                items->emplace_back(std::move(spare.back()));
+                spare.pop_back();
+            }
+            isSeen.push_back(1);
+            items->back().id = id;
+            return &items->back();
+        }
+
+        // Drops an acquired entry at end(), for ids the backend turns out to have no data for this frame
+        void release(const T* item) { isSeen[item - items->data()] = 0; }
+
+        void end()
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < items->size(); i++)
+            {
+                if (!isSeen[i])
+                    continue;
+                if (i != count)
+                    std::swap((*items)[count], (*items)[i]);
+                count++;
+            }
+            while (items->size() > count)
+            {
+                if (spare.size() < capacity)
+                    spare.emplace_back(std::move(items->back()));
+                items->pop_back();
+            }
+        }
+
+        std::vector<T>* items = nullptr;
+        size_t capacity = 0;
+        std::vector<T> spare;
+        std::vector<uint8_t> isSeen;
+    };
+} // namespace ds
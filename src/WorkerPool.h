@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ds
+{
+    // A few threads draining a job queue, for per-frame work (decoding, conversion) that should neither block the
+    // capture thread nor the app. Jobs still queued when the pool stops are dropped, running ones finish first.
+    struct WorkerPool
+    {
+        ~WorkerPool() { stop(); }
+
+        void start(size_t threadCount)
+        {
+            stop();
+            isRunning = true;
+            for (size_t i = 0; i < threadCount; i++)
+                threads.emplace_back(&WorkerPool::loop, this);
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                isRunning = false;
+                jobs.clear();
+            }
+            jobReady.notify_all();
+            for (auto& thread : threads)
+                thread.join();
+            threads.clear();
+        }
+
+        // Returns false without queueing when pendingCount() has reached maxPending, so producers can drop
+        // frames instead of falling behind
+        bool run(std::function<void()> job, size_t maxPending = SIZE_MAX)
+        {
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                if (!isRunning || jobs.size() + busyCount >= maxPending)
+                    return false;
+                jobs.emplace_back(std::move(job));
+            }
+            jobReady.notify_one();
+            return true;
+        }
+
+        size_t pendingCount()
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            return jobs.size() + busyCount;
+        }
+
+        size_t threadCount() const { return threads.size(); }
+
+      private:
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            while (true)
+            {
+                jobReady.wait(lock, [this] { return !isRunning || !jobs.empty(); });
+                if (!isRunning)
+                    return;
+
+                auto job = std::move(jobs.front());
+                jobs.pop_front();
+                busyCount++;
+                lock.unlock();
+                job();
+                lock.lock();
+                busyCount--;
+            }
+        }
+
+        std::vector<std::thread> threads;
+        std::mutex jobMutex;
+        std::condition_variable jobReady;
+        std::deque<std::function<void()>> jobs;
+        size_t busyCount = 0;
+        bool isRunning = false;
+    };
+} // namespace ds
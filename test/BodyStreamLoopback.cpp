@@ -0,0 +1,192 @@
+// Checks BodyPublisher and BodyReceiver over udp://127.0.0.1 and, outside Windows, a Unix socket: 20 s of a simulated
+// walking crowd of 6 bodies must arrive within the quantization bounds, with no operator new once the first keyframe
+// interval is over. Also checks that a BodyDecoder that lost a frame rejects deltas until the next keyframe, then
+// decodes again. Prints bytes per body and encode time per frame. Exits non-zero on failure.
+//
+// Needs Cinder like the block itself: build it as a console program out of this file, the block's src/*.cpp and
+// libcinder, e.g. from a Cinder project that uses the block with this file in place of the app's source.
+
+#include "BodyStream.h"
+#include "SimulatedScene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+using namespace ci;
+using namespace ds;
+using namespace std;
+
+namespace
+{
+    std::atomic<size_t> allocationCount{0};
+
+    const int kBodyCount = 6;
+    const int kFrameCount = 20 * 30;
+    const double kFps = 30;
+
+    // Half a quantization step per axis, and a little for float rounding
+    const float kPositionStep = BodyEncoder::Options().positionStep;
+    const float kMaxPositionError = kPositionStep * 0.5f + 1e-5f;
+    const float kMaxUvError = 0.5f / 4096 + 1e-6f;
+    const float kMaxAngleError = 0.1f; // degrees, 12 bits per quaternion component
+
+    int failures = 0;
+
+    void fail(const char* what, int frame)
+    {
+        if (failures++ < 10)
+            printf("frame %d: %s\n", frame, what);
+    }
+
+    // Everything the publisher sent is in the receive queue on loopback, waits a little longer just in case
+    bool receive(BodyReceiver& receiver, vector<Body>* bodies, uint64_t* timestamp)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            if (receiver.receive(bodies, timestamp))
+                return true;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    void checkLoopback(const char* address)
+    {
+        auto scene = SimulatedScene::createCrowd(kBodyCount, 7);
+        BodyReceiver receiver;
+        BodyPublisher publisher;
+        if (!receiver.setup(address) || !publisher.setup(address))
+        {
+            printf("%s: setup failed\n", address);
+            failures++;
+            return;
+        }
+
+        vector<Body> sent, received;
+        sent.reserve(BodyEncoder::kMaxBodies);
+        received.reserve(BodyEncoder::kMaxBodies);
+        float maxPositionError = 0, maxUvError = 0, maxAngleError = 0;
+        size_t allocations = 0;
+        for (int frame = 0; frame < kFrameCount; frame++)
+        {
+            scene->update(frame / kFps);
+            sent.assign(scene->bodies.begin(), scene->bodies.end());
+            const uint64_t sentTimestamp = (uint64_t)(frame * 1e6 / kFps);
+
+            const size_t allocationsBefore = allocationCount;
+            publisher.publish(sent, sentTimestamp);
+            uint64_t timestamp = 0;
+            const bool isReceived = receive(receiver, &received, &timestamp);
+            if (frame >= BodyEncoder::Options().keyframeInterval)
+                allocations += allocationCount - allocationsBefore;
+
+            if (!isReceived)
+            {
+                fail("not received", frame);
+                continue;
+            }
+            if (timestamp != sentTimestamp || received.size() != sent.size())
+            {
+                fail("wrong timestamp or body count", frame);
+                continue;
+            }
+            for (size_t b = 0; b < sent.size(); b++)
+            {
+                if (received[b].id != sent[b].id)
+                    fail("wrong body id", frame);
+                for (int j = 0; j < Body::JOINT_COUNT; j++)
+                {
+                    const Body::Joint& x = sent[b].joints[j];
+                    const Body::Joint& y = received[b].joints[j];
+                    const vec3 d3 = x.pos3d - y.pos3d;
+                    const vec2 d2 = x.pos2d - y.pos2d;
+                    const float cosHalfAngle = min(1.0f, std::abs(dot(x.orientation, y.orientation)));
+                    for (int c = 0; c < 3; c++)
+                        maxPositionError = max(maxPositionError, std::abs(d3[c]));
+                    for (int c = 0; c < 2; c++)
+                        maxUvError = max(maxUvError, std::abs(d2[c]));
+                    maxAngleError = max(maxAngleError, 2 * acos(cosHalfAngle) * 57.29578f);
+                    if (x.confidence != y.confidence)
+                        fail("wrong confidence", frame);
+                }
+            }
+        }
+
+        const BodyPublisher::Stats& stats = publisher.getStats();
+        printf("%s: %llu frames, %.1f bytes per body, encode %.0f ns per frame, max error %.3f mm, uv %.6f, %.3f "
+               "degrees, %llu allocations after warm-up\n",
+               address, (unsigned long long)stats.frames, stats.getBytesPerBody(), stats.getEncodeNanoseconds(),
+               maxPositionError * 1000, maxUvError, maxAngleError, (unsigned long long)allocations);
+        if (maxPositionError > kMaxPositionError || maxUvError > kMaxUvError || maxAngleError > kMaxAngleError)
+            fail("quantization error out of bounds", kFrameCount);
+        if (allocations != 0 || stats.dropped != 0)
+            fail("allocated or dropped in steady state", kFrameCount);
+    }
+
+    // Frame kLostFrame never reaches the decoder: deltas are rejected until the next keyframe, then all decode
+    void checkKeyframeRecovery()
+    {
+        const int kLostFrame = 40;
+        auto scene = SimulatedScene::createCrowd(kBodyCount, 3);
+        BodyEncoder encoder;
+        encoder.setup();
+        const int keyframeInterval = encoder.getOptions().keyframeInterval;
+        BodyDecoder decoder;
+        vector<uint8_t> buffer(BodyEncoder::kMaxBytes);
+        vector<Body> bodies;
+        int decodedBeforeKeyframe = 0, decodedAfterKeyframe = 0;
+        const int nextKeyframe = (kLostFrame / keyframeInterval + 1) * keyframeInterval;
+        for (int frame = 0; frame < nextKeyframe + keyframeInterval; frame++)
+        {
+            scene->update(frame / kFps);
+            const size_t size = encoder.encode(scene->bodies, frame, buffer.data(), buffer.size());
+            if (frame == kLostFrame)
+                continue;
+            uint64_t timestamp;
+            const bool isDecoded = decoder.decode(buffer.data(), size, &bodies, &timestamp);
+            if (frame < kLostFrame && !isDecoded)
+                fail("not decoded before the loss", frame);
+            decodedBeforeKeyframe += frame > kLostFrame && frame < nextKeyframe && isDecoded;
+            decodedAfterKeyframe += frame >= nextKeyframe && isDecoded;
+        }
+        printf("lost frame %d: %d of %d frames decoded before the next keyframe, %d of %d after\n", kLostFrame,
+               decodedBeforeKeyframe, nextKeyframe - kLostFrame - 1, decodedAfterKeyframe, keyframeInterval);
+        if (decodedBeforeKeyframe != 0 || decodedAfterKeyframe != keyframeInterval)
+            fail("no recovery at the keyframe", nextKeyframe);
+    }
+} // namespace
+
+// Out of line so that the compiler doesn't pair the inlined malloc with a delete elsewhere
+#if defined(_MSC_VER)
+#define DS_NOINLINE __declspec(noinline)
+#else
+#define DS_NOINLINE __attribute__((noinline))
+#endif
+
+DS_NOINLINE void* operator new(std::size_t size)
+{
+    allocationCount++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+DS_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+
+int main()
+{
+    checkKeyframeRecovery();
+    checkLoopback("udp://127.0.0.1:47001");
+#if !defined(_WIN32)
+    checkLoopback("unix:///tmp/ds_body_stream_loopback.sock");
+#endif
+
+    printf(failures == 0 ? "passed\n" : "FAILED\n");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
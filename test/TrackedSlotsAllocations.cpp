@@ -0,0 +1,151 @@
+// Checks that TrackedSlots publishes bodies and faces without touching the heap once set up: ids appear, stay
+// tracked for a while and disappear over 10k frames, faces of some ids are released again after acquire(), and
+// every operator new after setup() counts as a failure. Exits non-zero on failure.
+//
+// Build from the repository root:
+//   g++ -std=c++11 -O2 -Isrc test/TrackedSlotsAllocations.cpp -o TrackedSlotsAllocations
+//   cl /EHsc /O2 /Isrc test\TrackedSlotsAllocations.cpp
+
+#include "TrackedSlots.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<size_t> allocationCount{0};
+
+    // Stand-ins for ds::Body and ds::Face, which need Cinder: same id field, comparable size and a vertex buffer
+    struct TestBody
+    {
+        uint64_t id = 0;
+        float joints[32 * 14] = {};
+    };
+
+    struct TestFace
+    {
+        uint64_t id = 0;
+        std::vector<float> vertices;
+    };
+
+    const size_t kCapacity = 6;
+    const size_t kFaceVertexCount = 1347;
+    const int kFrameCount = 10000;
+
+    uint32_t nextRandom(uint32_t& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+} // namespace
+
+// Out of line so that the compiler doesn't pair the inlined malloc with a delete elsewhere
+#if defined(_MSC_VER)
+#define DS_NOINLINE __declspec(noinline)
+#else
+#define DS_NOINLINE __attribute__((noinline))
+#endif
+
+DS_NOINLINE void* operator new(std::size_t size)
+{
+    allocationCount++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+DS_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+
+int main()
+{
+    using namespace ds;
+
+    std::vector<TestBody> bodies;
+    std::vector<TestFace> faces;
+    TrackedSlots<TestBody> bodySlots;
+    TrackedSlots<TestFace> faceSlots;
+
+    TestFace prototype;
+    prototype.vertices.resize(kFaceVertexCount * 3);
+    bodySlots.setup(&bodies, kCapacity);
+    faceSlots.setup(&faces, kCapacity, prototype);
+
+    // Up to kCapacity + 2 ids are tracked at a time, so acquire() also runs out of slots now and then
+    uint64_t trackedIds[kCapacity + 2] = {};
+    int remainingFrames[kCapacity + 2] = {};
+    uint64_t nextId = 1;
+    uint32_t random = 12345;
+    int failures = 0;
+
+    const size_t allocationsAfterSetup = allocationCount;
+    for (int frame = 0; frame < kFrameCount; frame++)
+    {
+        for (size_t i = 0; i < kCapacity + 2; i++)
+        {
+            if (remainingFrames[i] > 0 && --remainingFrames[i] > 0)
+                continue;
+            // a lost id leaves a gap for a few frames before a new one shows up
+            if (trackedIds[i] != 0 || nextRandom(random) % 4 == 0)
+            {
+                trackedIds[i] = trackedIds[i] != 0 ? 0 : nextId++;
+                remainingFrames[i] = 1 + nextRandom(random) % 90;
+            }
+        }
+
+        bodySlots.begin();
+        faceSlots.begin();
+        for (size_t i = 0; i < kCapacity + 2; i++)
+        {
+            const uint64_t id = trackedIds[i];
+            if (id == 0)
+                continue;
+            TestBody* body = bodySlots.acquire(id);
+            if (body != nullptr)
+                body->joints[0] = (float)frame;
+
+            TestFace* face = faceSlots.acquire(id);
+            if (face != nullptr && id % 3 == 0)
+                faceSlots.release(face); // no face data for this id
+            else if (face != nullptr)
+                face->vertices[0] = (float)frame;
+        }
+        bodySlots.end();
+        faceSlots.end();
+
+        // Every published entry is tracked, filled this frame and unique
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            bool isTracked = false;
+            for (uint64_t id : trackedIds)
+                isTracked |= id != 0 && id == bodies[i].id;
+            for (size_t j = 0; j < i; j++)
+                isTracked &= bodies[j].id != bodies[i].id;
+            if (!isTracked || bodies[i].joints[0] != (float)frame)
+            {
+                std::printf("frame %d: unexpected body %llu\n", frame, (unsigned long long)bodies[i].id);
+                failures++;
+            }
+        }
+        for (const auto& face : faces)
+        {
+            if (face.id % 3 == 0 || face.vertices.size() != kFaceVertexCount * 3 || face.vertices[0] != (float)frame)
+            {
+                std::printf("frame %d: unexpected face %llu\n", frame, (unsigned long long)face.id);
+                failures++;
+            }
+        }
+        if (failures > 10)
+            break;
+    }
+
+    const size_t allocations = allocationCount - allocationsAfterSetup;
+    std::printf("%d frames, %llu ids, %llu allocations after setup\n", kFrameCount, (unsigned long long)nextId - 1,
+                (unsigned long long)allocations);
+    if (allocations != 0)
+        failures++;
+
+    std::printf(failures == 0 ? "passed\n" : "FAILED\n");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}